@@ -0,0 +1,314 @@
+#define _GNU_SOURCE
+#include "trace.h"
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define TRACE_X86 1
+#endif
+
+#define DEFAULT_EVENTS 65536
+#define FLUSH_BUFFER 65536
+
+struct TraceEvent {
+  const char *name;
+  uint64_t start;
+  uint64_t end; // == start for instants
+  int64_t value;
+  bool has_value;
+};
+
+struct TraceRing {
+  struct TraceRing *next;
+  pid_t tid;
+  char thread_name[32];
+  size_t capacity;
+  atomic_ulong head;     // events ever written; slot head % capacity is next
+  unsigned long flushed; // head at the previous flush
+  struct TraceEvent *events;
+};
+
+static bool use_tsc;
+static uint64_t init_ticks;
+static uint64_t init_ns;
+static double ns_per_tick = 1.0;
+
+static bool enabled;
+static char trace_path[PATH_MAX];
+static size_t ring_capacity = DEFAULT_EVENTS;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct TraceRing *rings;
+static __thread struct TraceRing *thread_ring;
+
+static uint64_t MonotonicNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t TraceNow(void) {
+#ifdef TRACE_X86
+  if (use_tsc)
+    return __rdtsc();
+#endif
+  return MonotonicNs();
+}
+
+static bool HaveInvariantTsc(void) {
+#ifdef TRACE_X86
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    return false;
+  return (edx >> 8) & 1;
+#else
+  return false;
+#endif
+}
+
+// Chooses the clock and takes a first rate from a ~200 us window; later
+// conversions refine it over the whole run
+__attribute__((constructor)) static void TraceClockInit(void) {
+  const char *clock_env = getenv("TRACE_CLOCK");
+  use_tsc = HaveInvariantTsc() &&
+            !(clock_env != NULL && strcmp(clock_env, "monotonic") == 0);
+  init_ns = MonotonicNs();
+  init_ticks = TraceNow();
+  if (!use_tsc)
+    return;
+  uint64_t ns, ticks;
+  do {
+    ns = MonotonicNs();
+    ticks = TraceNow();
+  } while (ns - init_ns < 200000);
+  ns_per_tick = (double)(ns - init_ns) / (double)(ticks - init_ticks);
+}
+
+static double NsPerTick(void) {
+  if (!use_tsc)
+    return 1.0;
+  uint64_t ns = MonotonicNs();
+  uint64_t ticks = TraceNow();
+  // Past 10 ms the run itself is a better calibration window
+  if (ns - init_ns < 10000000 || ticks <= init_ticks)
+    return ns_per_tick;
+  return (double)(ns - init_ns) / (double)(ticks - init_ticks);
+}
+
+double TraceTicksToMs(uint64_t start, uint64_t end) {
+  return end > start ? (double)(end - start) * NsPerTick() / 1e6 : 0.0;
+}
+
+bool TraceEnabled(void) { return enabled; }
+
+static void ForkPrepare(void) { pthread_mutex_lock(&registry_lock); }
+
+static void ForkParent(void) { pthread_mutex_unlock(&registry_lock); }
+
+// The child only has the forking thread, and its events so far belong to
+// the parent's trace
+static void ForkChild(void) {
+  pthread_mutex_init(&registry_lock, NULL);
+  rings = thread_ring;
+  if (thread_ring != NULL) {
+    thread_ring->next = NULL;
+    thread_ring->tid = gettid();
+    atomic_store(&thread_ring->head, 0);
+    thread_ring->flushed = 0;
+  }
+}
+
+void TraceInit(const char *path) {
+  if (path == NULL || path[0] == '\0' || enabled)
+    return;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    return;
+  }
+  if (write(fd, "[\n", 2) != 2)
+    perror(path);
+  close(fd);
+
+  snprintf(trace_path, sizeof(trace_path), "%s", path);
+  const char *events = getenv("TRACE_EVENTS");
+  if (events != NULL && atol(events) > 0)
+    ring_capacity = (size_t)atol(events);
+  pthread_atfork(ForkPrepare, ForkParent, ForkChild);
+  atexit(TraceFlush);
+  enabled = true;
+}
+
+static struct TraceRing *ThreadRing(void) {
+  if (thread_ring != NULL)
+    return thread_ring;
+  struct TraceRing *ring = calloc(1, sizeof(struct TraceRing));
+  if (ring == NULL)
+    return NULL;
+  ring->events = malloc(ring_capacity * sizeof(struct TraceEvent));
+  if (ring->events == NULL) {
+    free(ring);
+    return NULL;
+  }
+  ring->capacity = ring_capacity;
+  ring->tid = gettid();
+  pthread_mutex_lock(&registry_lock);
+  ring->next = rings;
+  rings = ring;
+  pthread_mutex_unlock(&registry_lock);
+  thread_ring = ring;
+  return ring;
+}
+
+static void Record(const char *name, uint64_t start, uint64_t end,
+                   int64_t value, bool has_value) {
+  struct TraceRing *ring = ThreadRing();
+  if (ring == NULL)
+    return;
+  unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  struct TraceEvent *event = &ring->events[head % ring->capacity];
+  event->name = name;
+  event->start = start;
+  event->end = end;
+  event->value = value;
+  event->has_value = has_value;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void TraceEnd(struct TraceSpan span) {
+  if (enabled)
+    Record(span.name, span.start, TraceNow(), 0, false);
+}
+
+void TraceEndArg(struct TraceSpan span, int64_t value) {
+  if (enabled)
+    Record(span.name, span.start, TraceNow(), value, true);
+}
+
+double TraceEndMs(struct TraceSpan span) {
+  uint64_t end = TraceNow();
+  if (enabled)
+    Record(span.name, span.start, end, 0, false);
+  return TraceTicksToMs(span.start, end);
+}
+
+void TraceInstant(const char *name) {
+  if (enabled) {
+    uint64_t now = TraceNow();
+    Record(name, now, now, 0, false);
+  }
+}
+
+void TraceSetThreadName(const char *name) {
+  if (!enabled)
+    return;
+  struct TraceRing *ring = ThreadRing();
+  if (ring != NULL)
+    snprintf(ring->thread_name, sizeof(ring->thread_name), "%s", name);
+}
+
+struct FlushBuffer {
+  int fd;
+  size_t used;
+  char data[FLUSH_BUFFER];
+};
+
+// Writes whole lines only, so appends of several processes never mix
+// inside an event
+static void FlushBufferWrite(struct FlushBuffer *buf) {
+  size_t done = 0;
+  while (done < buf->used) {
+    ssize_t n = write(buf->fd, buf->data + done, buf->used - done);
+    if (n <= 0)
+      break;
+    done += (size_t)n;
+  }
+  buf->used = 0;
+}
+
+static void Append(struct FlushBuffer *buf, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void Append(struct FlushBuffer *buf, const char *format, ...) {
+  if (FLUSH_BUFFER - buf->used < 512)
+    FlushBufferWrite(buf);
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buf->data + buf->used, FLUSH_BUFFER - buf->used, format,
+                    args);
+  va_end(args);
+  if (n > 0 && (size_t)n < FLUSH_BUFFER - buf->used)
+    buf->used += (size_t)n;
+}
+
+// Names are literals chosen by the programs; only quotes and backslashes
+// would break the JSON
+static const char *SafeName(const char *name) {
+  return strpbrk(name, "\"\\") == NULL ? name : "?";
+}
+
+void TraceFlush(void) {
+  if (!enabled)
+    return;
+  static struct FlushBuffer buf;
+  pthread_mutex_lock(&registry_lock);
+  buf.fd = open(trace_path, O_WRONLY | O_APPEND);
+  if (buf.fd < 0) {
+    pthread_mutex_unlock(&registry_lock);
+    return;
+  }
+  buf.used = 0;
+  pid_t pid = getpid();
+  double us_per_tick = NsPerTick() / 1000.0;
+
+  for (struct TraceRing *ring = rings; ring != NULL; ring = ring->next) {
+    unsigned long head = atomic_load_explicit(&ring->head,
+                                              memory_order_acquire);
+    unsigned long from = ring->flushed;
+    if (head - from > ring->capacity)
+      from = head - ring->capacity; // the oldest ones were overwritten
+    if (ring->thread_name[0] != '\0')
+      Append(&buf,
+             "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+             "\"args\":{\"name\":\"%s\"}},\n",
+             (int)pid, (int)ring->tid, SafeName(ring->thread_name));
+    for (unsigned long i = from; i < head; i++) {
+      const struct TraceEvent *e = &ring->events[i % ring->capacity];
+      double ts = (double)(e->start - init_ticks) * us_per_tick;
+      if (e->end == e->start && !e->has_value) {
+        Append(&buf,
+               "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,"
+               "\"tid\":%d,\"ts\":%.3f},\n",
+               SafeName(e->name), (int)pid, (int)ring->tid, ts);
+        continue;
+      }
+      double dur = (double)(e->end - e->start) * us_per_tick;
+      if (e->has_value)
+        Append(&buf,
+               "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+               "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"value\":%lld}},\n",
+               SafeName(e->name), (int)pid, (int)ring->tid, ts, dur,
+               (long long)e->value);
+      else
+        Append(&buf,
+               "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+               "\"ts\":%.3f,\"dur\":%.3f},\n",
+               SafeName(e->name), (int)pid, (int)ring->tid, ts, dur);
+    }
+    ring->flushed = head;
+  }
+  FlushBufferWrite(&buf);
+  close(buf.fd);
+  pthread_mutex_unlock(&registry_lock);
+}
@@ -0,0 +1,65 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hot-path timing and tracing shared by the lab programs.
+//
+// Time is read as raw ticks: the invariant TSC on x86 when the CPU has
+// one, CLOCK_MONOTONIC nanoseconds otherwise (or with TRACE_CLOCK=monotonic
+// in the environment). Ticks are converted with a rate calibrated against
+// CLOCK_MONOTONIC, so a span costs one rdtsc at each end.
+//
+// Spans always measure; they are recorded only after TraceInit with a
+// file. Every thread then appends to its own ring buffer (the oldest
+// events are overwritten when it is full, TRACE_EVENTS sets the size) and
+// TraceFlush writes them out as Chrome trace JSON, viewable in
+// chrome://tracing or ui.perfetto.dev. Flushes append with O_APPEND and
+// the closing bracket is left out, which both viewers accept, so forked
+// children add their own events to the same file: they start with empty
+// buffers and flush on exit.
+
+struct TraceSpan {
+  const char *name; // must outlive the trace: a string literal
+  uint64_t start;
+};
+
+// Truncates path and starts recording; NULL or "" leaves tracing off.
+// Registers TraceFlush with atexit. Call once, before creating threads.
+void TraceInit(const char *path);
+
+bool TraceEnabled(void);
+
+uint64_t TraceNow(void);
+
+// Length of [start, end] in milliseconds
+double TraceTicksToMs(uint64_t start, uint64_t end);
+
+static inline struct TraceSpan TraceBegin(const char *name) {
+  struct TraceSpan span = {name, TraceNow()};
+  return span;
+}
+
+// Records the span when tracing
+void TraceEnd(struct TraceSpan span);
+
+// Same with an integer shown as args.value in the viewer
+void TraceEndArg(struct TraceSpan span, int64_t value);
+
+// TraceEnd that also returns the span's length in milliseconds, for the
+// programs' own timing output
+double TraceEndMs(struct TraceSpan span);
+
+// Zero-length marker
+void TraceInstant(const char *name);
+
+// Name of the calling thread's track in the viewer
+void TraceSetThreadName(const char *name);
+
+// Writes every event recorded since the previous flush. Safe to call while
+// other threads keep tracing; an event being overwritten at that moment
+// may come out garbled.
+void TraceFlush(void);
+
+#endif
@@ -0,0 +1,290 @@
+#include "work_stealing.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Задача [begin, end) упакована в 64 бита: begin в младших 32, end в
+// старших. Так ячейку деки можно читать и писать одним атомиком.
+typedef uint64_t WsTask;
+
+// Емкость деки. Поток кладет в деку только правые половины по пути
+// деления одной задачи, их не больше log2(2^32) = 32, так что 64 ячеек
+// хватает всегда и дека не растет.
+#define WS_DEQUE_SIZE 64
+#define WS_CACHE_LINE 64
+
+static inline WsTask WsMakeTask(size_t begin, size_t end) {
+    return (uint64_t)(uint32_t)begin | ((uint64_t)(uint32_t)end << 32);
+}
+
+static inline size_t WsTaskBegin(WsTask task) { return (uint32_t)task; }
+static inline size_t WsTaskEnd(WsTask task) { return (uint32_t)(task >> 32); }
+
+// Дека Chase-Lev (вариант Le, Pop, Cohen, Zappa Nardelli для C11 атомиков).
+// bottom меняет только владелец, top двигают воры через CAS.
+struct WsDeque {
+    _Alignas(WS_CACHE_LINE) atomic_long top;
+    _Alignas(WS_CACHE_LINE) atomic_long bottom;
+    _Atomic WsTask tasks[WS_DEQUE_SIZE];
+};
+
+static void WsDequePush(struct WsDeque *deque, WsTask task) {
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    atomic_store_explicit(&deque->tasks[b % WS_DEQUE_SIZE], task,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+}
+
+static bool WsDequeTake(struct WsDeque *deque, WsTask *task) {
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (t > b) {
+        // Дека пуста
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return false;
+    }
+
+    *task = atomic_load_explicit(&deque->tasks[b % WS_DEQUE_SIZE],
+                                 memory_order_relaxed);
+    if (t == b) {
+        // Последний элемент: гонка с ворами решается через CAS по top
+        bool won = atomic_compare_exchange_strong_explicit(
+            &deque->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+static bool WsDequeSteal(struct WsDeque *deque, WsTask *task) {
+    long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (t >= b) return false;
+
+    *task = atomic_load_explicit(&deque->tasks[t % WS_DEQUE_SIZE],
+                                 memory_order_relaxed);
+    return atomic_compare_exchange_strong_explicit(
+        &deque->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+}
+
+struct WsWorker {
+    struct WsDeque deque;
+    pthread_t thread;
+    struct WsPool *pool;
+    int index;
+    uint32_t random;  // состояние xorshift для выбора жертвы
+    unsigned long steals;
+};
+
+struct WsPool {
+    int threads_num;
+    struct WsWorker *workers;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    unsigned long generation;
+    bool shutdown;
+    int finished;
+
+    // Текущая задача
+    const struct WsReduction *reduction;
+    void *ctx;
+    size_t grain;
+    char *partials;        // по одному выровненному слоту на поток
+    size_t partial_stride;
+    atomic_size_t remaining;  // сколько элементов еще не обработано
+};
+
+static int WsVictim(struct WsWorker *worker) {
+    uint32_t x = worker->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    worker->random = x;
+    return (int)(x % (uint32_t)worker->pool->threads_num);
+}
+
+// Делим задачу до grain, правые половины отдаем в деку, левую считаем сами
+static void WsProcess(struct WsWorker *worker, WsTask task, void *partial) {
+    struct WsPool *pool = worker->pool;
+    size_t begin = WsTaskBegin(task);
+    size_t end = WsTaskEnd(task);
+
+    while (end - begin > pool->grain) {
+        size_t middle = begin + (end - begin) / 2;
+        WsDequePush(&worker->deque, WsMakeTask(middle, end));
+        end = middle;
+    }
+
+    pool->reduction->leaf(pool->ctx, begin, end, partial);
+    atomic_fetch_sub_explicit(&pool->remaining, end - begin,
+                              memory_order_release);
+}
+
+static void WsRun(struct WsWorker *worker) {
+    struct WsPool *pool = worker->pool;
+    void *partial = pool->partials + worker->index * pool->partial_stride;
+    memcpy(partial, pool->reduction->identity, pool->reduction->partial_size);
+    worker->steals = 0;
+
+    while (atomic_load_explicit(&pool->remaining, memory_order_acquire) > 0) {
+        WsTask task;
+        if (WsDequeTake(&worker->deque, &task)) {
+            WsProcess(worker, task, partial);
+            continue;
+        }
+
+        int victim = WsVictim(worker);
+        if (victim != worker->index &&
+            WsDequeSteal(&pool->workers[victim].deque, &task)) {
+            worker->steals++;
+            WsProcess(worker, task, partial);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+static void *WsWorkerLoop(void *arg) {
+    struct WsWorker *worker = (struct WsWorker *)arg;
+    struct WsPool *pool = worker->pool;
+    unsigned long seen_generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (true) {
+        while (!pool->shutdown && pool->generation == seen_generation) {
+            pthread_cond_wait(&pool->start_cond, &pool->mutex);
+        }
+        if (pool->shutdown) break;
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        WsRun(worker);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (++pool->finished == pool->threads_num - 1) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+struct WsPool *WsPoolCreate(int threads_num) {
+    if (threads_num <= 0) return NULL;
+
+    struct WsPool *pool = calloc(1, sizeof(struct WsPool));
+    if (pool == NULL) return NULL;
+
+    pool->workers = aligned_alloc(WS_CACHE_LINE,
+                                  sizeof(struct WsWorker) * threads_num);
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    memset(pool->workers, 0, sizeof(struct WsWorker) * threads_num);
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    pool->threads_num = threads_num;
+    for (int i = 0; i < threads_num; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pool->workers[i].random = 2654435761u * (uint32_t)(i + 1);
+    }
+
+    // Поток 0 - вызывающий, остальные создаем
+    for (int i = 1; i < threads_num; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, WsWorkerLoop,
+                           &pool->workers[i]) != 0) {
+            pool->threads_num = i;
+            WsPoolDestroy(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+void WsPoolReduce(struct WsPool *pool, size_t begin, size_t end, size_t grain,
+                  const struct WsReduction *reduction, void *ctx,
+                  void *result) {
+    memcpy(result, reduction->identity, reduction->partial_size);
+    if (begin >= end) return;
+
+    size_t stride = (reduction->partial_size + WS_CACHE_LINE - 1) /
+                    WS_CACHE_LINE * WS_CACHE_LINE;
+    char *partials = aligned_alloc(WS_CACHE_LINE, stride * pool->threads_num);
+    if (partials == NULL) {
+        // Без памяти под частичные результаты считаем сами
+        reduction->leaf(ctx, begin, end, result);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->reduction = reduction;
+    pool->ctx = ctx;
+    pool->grain = grain > 0 ? grain : 1;
+    pool->partials = partials;
+    pool->partial_stride = stride;
+    pool->finished = 0;
+    atomic_store(&pool->remaining, end - begin);
+    WsDequePush(&pool->workers[0].deque, WsMakeTask(begin, end));
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    WsRun(&pool->workers[0]);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->finished < pool->threads_num - 1) {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->threads_num; i++) {
+        reduction->combine(result, partials + i * stride);
+    }
+    free(partials);
+}
+
+unsigned long WsPoolSteals(const struct WsPool *pool) {
+    unsigned long steals = 0;
+    for (int i = 0; i < pool->threads_num; i++) {
+        steals += pool->workers[i].steals;
+    }
+    return steals;
+}
+
+void WsPoolDestroy(struct WsPool *pool) {
+    if (pool == NULL) return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 1; i < pool->threads_num; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,46 @@
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <stddef.h>
+
+// Небольшой рантайм с кражей работы (work stealing) для редукций по
+// диапазону индексов. У каждого потока своя дека Chase-Lev с задачами
+// вида [begin, end). Поток берет задачу со своего конца деки, делит ее
+// пополам до grain элементов, правую половину кладет обратно в деку,
+// а свободные потоки крадут задачи с противоположного конца чужих дек.
+// Поэтому медленный или занятый поток не задерживает остальных:
+// его необработанная работа уходит к тем, кто освободился.
+
+// Обработать [begin, end) и добавить результат в partial (свой у каждого
+// потока, partial_size байт).
+typedef void (*WsLeafFunc)(void *ctx, size_t begin, size_t end, void *partial);
+
+// into = into (+) from. Операция должна быть ассоциативной и коммутативной
+// (сумма, min/max): порядок объединения частей не фиксирован.
+typedef void (*WsCombineFunc)(void *into, const void *from);
+
+struct WsReduction {
+    WsLeafFunc leaf;
+    WsCombineFunc combine;
+    const void *identity;  // нейтральный элемент, partial_size байт
+    size_t partial_size;
+};
+
+struct WsPool;
+
+// Пул из threads_num потоков, включая вызывающий: создается
+// threads_num - 1 рабочих, вызывающий поток работает наравне с ними.
+struct WsPool *WsPoolCreate(int threads_num);
+
+// Редукция по [begin, end), результат (partial_size байт) пишется в result.
+// Диапазон ограничен 2^32 элементами (задача хранится в 64 битах).
+void WsPoolReduce(struct WsPool *pool, size_t begin, size_t end, size_t grain,
+                  const struct WsReduction *reduction, void *ctx,
+                  void *result);
+
+// Сколько задач было украдено за последний WsPoolReduce
+unsigned long WsPoolSteals(const struct WsPool *pool);
+
+void WsPoolDestroy(struct WsPool *pool);
+
+#endif
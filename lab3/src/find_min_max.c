@@ -1,27 +1,192 @@
 #include "find_min_max.h"
 
 #include <limits.h>
+#include <stdint.h>
 
-struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end){
+#ifdef FIND_MIN_MAX_X86
+#include <immintrin.h>
+#endif
+
+typedef struct MinMax (*GetMinMaxFunc)(int *array, unsigned int begin,
+                                       unsigned int end);
+
+static GetMinMaxFunc get_min_max_impl = GetMinMaxScalar;
+static const char *get_min_max_name = "scalar";
+
+static inline void UpdateMinMax(struct MinMax *min_max, int value) {
+  if (value < min_max->min) min_max->min = value;
+  if (value > min_max->max) min_max->max = value;
+}
+
+struct MinMax GetMinMaxScalar(int *array, unsigned int begin, unsigned int end) {
   struct MinMax min_max;
   min_max.min = INT_MAX;
   min_max.max = INT_MIN;
 
-  // your code here
-
   // Проходим по всем элементам в промежутке [begin, end)
   for (unsigned int i = begin; i < end; i++) {
-    if (array[i] < min_max.min) {
-      min_max.min = array[i]; // обновляем минимум
+    UpdateMinMax(&min_max, array[i]);
+  }
+
+  return min_max;
+}
+
+#ifdef FIND_MIN_MAX_X86
+
+// Общая схема векторных версий:
+//   1) скалярно доходим до адреса, выровненного на ширину регистра;
+//   2) держим текущие min/max в векторных регистрах (без ветвлений);
+//   3) сворачиваем регистры и дообрабатываем хвост скалярно.
+
+__attribute__((target("sse4.1")))
+struct MinMax GetMinMaxSSE41(int *array, unsigned int begin, unsigned int end) {
+  struct MinMax min_max = {INT_MAX, INT_MIN};
+  if (begin >= end) return min_max;
+  unsigned int i = begin;
+
+  while (i < end && ((uintptr_t)(array + i) & 15) != 0) {
+    UpdateMinMax(&min_max, array[i++]);
+  }
+
+  if (end - i >= 4) {
+    __m128i vmin = _mm_set1_epi32(min_max.min);
+    __m128i vmax = _mm_set1_epi32(min_max.max);
+    for (; end - i >= 4; i += 4) {
+      __m128i v = _mm_load_si128((const __m128i *)(array + i));
+      vmin = _mm_min_epi32(vmin, v);
+      vmax = _mm_max_epi32(vmax, v);
+    }
+
+    int lanes_min[4], lanes_max[4];
+    _mm_storeu_si128((__m128i *)lanes_min, vmin);
+    _mm_storeu_si128((__m128i *)lanes_max, vmax);
+    for (int lane = 0; lane < 4; lane++) {
+      UpdateMinMax(&min_max, lanes_min[lane]);
+      UpdateMinMax(&min_max, lanes_max[lane]);
+    }
+  }
+
+  for (; i < end; i++) {
+    UpdateMinMax(&min_max, array[i]);
+  }
+
+  return min_max;
+}
+
+__attribute__((target("avx2")))
+struct MinMax GetMinMaxAVX2(int *array, unsigned int begin, unsigned int end) {
+  struct MinMax min_max = {INT_MAX, INT_MIN};
+  if (begin >= end) return min_max;
+  unsigned int i = begin;
+
+  while (i < end && ((uintptr_t)(array + i) & 31) != 0) {
+    UpdateMinMax(&min_max, array[i++]);
+  }
+
+  if (end - i >= 8) {
+    // Две независимые пары аккумуляторов, чтобы не упираться в задержку
+    // vpminsd/vpmaxsd на одном регистре.
+    __m256i vmin0 = _mm256_set1_epi32(min_max.min);
+    __m256i vmax0 = _mm256_set1_epi32(min_max.max);
+    __m256i vmin1 = vmin0;
+    __m256i vmax1 = vmax0;
+    for (; end - i >= 16; i += 16) {
+      __m256i v0 = _mm256_load_si256((const __m256i *)(array + i));
+      __m256i v1 = _mm256_load_si256((const __m256i *)(array + i + 8));
+      vmin0 = _mm256_min_epi32(vmin0, v0);
+      vmax0 = _mm256_max_epi32(vmax0, v0);
+      vmin1 = _mm256_min_epi32(vmin1, v1);
+      vmax1 = _mm256_max_epi32(vmax1, v1);
     }
-    if (array[i] > min_max.max) {
-      min_max.max = array[i]; // обновляем максимум
+    for (; end - i >= 8; i += 8) {
+      __m256i v = _mm256_load_si256((const __m256i *)(array + i));
+      vmin0 = _mm256_min_epi32(vmin0, v);
+      vmax0 = _mm256_max_epi32(vmax0, v);
     }
+    vmin0 = _mm256_min_epi32(vmin0, vmin1);
+    vmax0 = _mm256_max_epi32(vmax0, vmax1);
+
+    int lanes_min[8], lanes_max[8];
+    _mm256_storeu_si256((__m256i *)lanes_min, vmin0);
+    _mm256_storeu_si256((__m256i *)lanes_max, vmax0);
+    for (int lane = 0; lane < 8; lane++) {
+      UpdateMinMax(&min_max, lanes_min[lane]);
+      UpdateMinMax(&min_max, lanes_max[lane]);
+    }
+  }
+
+  for (; i < end; i++) {
+    UpdateMinMax(&min_max, array[i]);
+  }
+
+  return min_max;
+}
+
+__attribute__((target("avx512f")))
+struct MinMax GetMinMaxAVX512(int *array, unsigned int begin, unsigned int end) {
+  struct MinMax min_max = {INT_MAX, INT_MIN};
+  if (begin >= end) return min_max;
+  unsigned int i = begin;
+
+  // В AVX-512 голову и хвост удобнее обработать маскированной загрузкой,
+  // чем скалярным циклом.
+  unsigned int head = (unsigned int)(((64 - ((uintptr_t)(array + i) & 63)) & 63) /
+                                     sizeof(int));
+  if (head > end - i) head = end - i;
+
+  __m512i vmin = _mm512_set1_epi32(INT_MAX);
+  __m512i vmax = _mm512_set1_epi32(INT_MIN);
+
+  if (head > 0) {
+    __mmask16 mask = (__mmask16)((1u << head) - 1);
+    vmin = _mm512_mask_min_epi32(vmin, mask, vmin,
+                                 _mm512_maskz_loadu_epi32(mask, array + i));
+    vmax = _mm512_mask_max_epi32(vmax, mask, vmax,
+                                 _mm512_maskz_loadu_epi32(mask, array + i));
+    i += head;
+  }
+
+  for (; end - i >= 16; i += 16) {
+    __m512i v = _mm512_load_si512((const void *)(array + i));
+    vmin = _mm512_min_epi32(vmin, v);
+    vmax = _mm512_max_epi32(vmax, v);
   }
 
+  if (i < end) {
+    __mmask16 mask = (__mmask16)((1u << (end - i)) - 1);
+    __m512i v = _mm512_maskz_loadu_epi32(mask, array + i);
+    vmin = _mm512_mask_min_epi32(vmin, mask, vmin, v);
+    vmax = _mm512_mask_max_epi32(vmax, mask, vmax, v);
+  }
+
+  min_max.min = _mm512_reduce_min_epi32(vmin);
+  min_max.max = _mm512_reduce_max_epi32(vmax);
   return min_max;
 }
 
+// Выбор реализации один раз при загрузке программы (до main).
+__attribute__((constructor)) static void SelectGetMinMax(void) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    get_min_max_impl = GetMinMaxAVX512;
+    get_min_max_name = "avx512";
+  } else if (__builtin_cpu_supports("avx2")) {
+    get_min_max_impl = GetMinMaxAVX2;
+    get_min_max_name = "avx2";
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    get_min_max_impl = GetMinMaxSSE41;
+    get_min_max_name = "sse4.1";
+  }
+}
+
+#endif
+
+struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end) {
+  return get_min_max_impl(array, begin, end);
+}
+
+const char *GetMinMaxKernelName(void) { return get_min_max_name; }
+
 // #include <stdio.h>
 // #include "find_min_max.h"
 
@@ -3,6 +3,25 @@
 
 #include "utils.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#define FIND_MIN_MAX_X86 1
+#endif
+
+// Ищет минимум и максимум на промежутке [begin, end).
+// Реализация (scalar/SSE4.1/AVX2/AVX-512) выбирается один раз при старте
+// программы по CPUID. Для пустого промежутка возвращает {INT_MAX, INT_MIN}.
 struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end);
 
+// Имя выбранной реализации ("scalar", "sse4.1", "avx2", "avx512").
+const char *GetMinMaxKernelName(void);
+
+// Отдельные реализации, доступны для тестов и замеров.
+// Векторные версии можно вызывать только если процессор их поддерживает.
+struct MinMax GetMinMaxScalar(int *array, unsigned int begin, unsigned int end);
+#ifdef FIND_MIN_MAX_X86
+struct MinMax GetMinMaxSSE41(int *array, unsigned int begin, unsigned int end);
+struct MinMax GetMinMaxAVX2(int *array, unsigned int begin, unsigned int end);
+struct MinMax GetMinMaxAVX512(int *array, unsigned int begin, unsigned int end);
+#endif
+
 #endif
@@ -0,0 +1,196 @@
+#include "min_max_pool.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "find_min_max.h"
+#include "trace.h"
+
+// Размер блока между проверками флага отмены (256 КБ для int).
+#define MIN_MAX_POOL_BLOCK (1u << 16)
+
+struct MinMaxWorker {
+    pthread_t thread;
+    struct MinMaxPool *pool;
+    int index;
+    struct MinMax result;
+    bool completed;
+};
+
+struct MinMaxPool {
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;  // новая задача или завершение пула
+    pthread_cond_t done_cond;   // очередной поток закончил работу
+    int threads_num;
+    struct MinMaxWorker *workers;
+
+    unsigned long generation;   // номер текущей задачи
+    bool shutdown;
+    int finished;               // сколько потоков вернулось из задачи
+
+    int *array;
+    unsigned int array_size;
+    atomic_bool cancel;
+};
+
+static void *MinMaxWorkerLoop(void *arg) {
+    struct MinMaxWorker *worker = (struct MinMaxWorker *)arg;
+    struct MinMaxPool *pool = worker->pool;
+    unsigned long seen_generation = 0;
+
+    char trace_name[32];
+    snprintf(trace_name, sizeof(trace_name), "pool worker %d", worker->index);
+    TraceSetThreadName(trace_name);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (true) {
+        while (!pool->shutdown && pool->generation == seen_generation) {
+            pthread_cond_wait(&pool->start_cond, &pool->mutex);
+        }
+        if (pool->shutdown) break;
+        seen_generation = pool->generation;
+
+        int *array = pool->array;
+        unsigned int chunk_size = pool->array_size / pool->threads_num;
+        unsigned int begin = worker->index * chunk_size;
+        unsigned int end = (worker->index == pool->threads_num - 1)
+                               ? pool->array_size
+                               : begin + chunk_size;
+        pthread_mutex_unlock(&pool->mutex);
+
+        // Кооперативная отмена: флаг проверяется перед каждым блоком
+        struct TraceSpan scan = TraceBegin("scan");
+        struct MinMax local = {INT_MAX, INT_MIN};
+        bool cancelled = false;
+        for (unsigned int i = begin; i < end; i += MIN_MAX_POOL_BLOCK) {
+            if (atomic_load_explicit(&pool->cancel, memory_order_relaxed)) {
+                cancelled = true;
+                break;
+            }
+            unsigned int block_end = (end - i > MIN_MAX_POOL_BLOCK)
+                                         ? i + MIN_MAX_POOL_BLOCK
+                                         : end;
+            struct MinMax block = GetMinMax(array, i, block_end);
+            if (block.min < local.min) local.min = block.min;
+            if (block.max > local.max) local.max = block.max;
+        }
+
+        TraceEndArg(scan, end - begin);
+
+        pthread_mutex_lock(&pool->mutex);
+        worker->result = local;
+        worker->completed = !cancelled;
+        if (++pool->finished == pool->threads_num) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+struct MinMaxPool *MinMaxPoolCreate(int threads_num) {
+    struct MinMaxPool *pool = calloc(1, sizeof(struct MinMaxPool));
+    if (pool == NULL) return NULL;
+
+    pool->workers = calloc(threads_num, sizeof(struct MinMaxWorker));
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    atomic_init(&pool->cancel, false);
+
+    for (int i = 0; i < threads_num; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if (pthread_create(&pool->workers[i].thread, NULL, MinMaxWorkerLoop,
+                           &pool->workers[i]) != 0) {
+            printf("Error: pthread_create failed!\n");
+            pool->threads_num = i;
+            MinMaxPoolDestroy(pool);
+            return NULL;
+        }
+    }
+    pool->threads_num = threads_num;
+
+    return pool;
+}
+
+int MinMaxPoolRun(struct MinMaxPool *pool, int *array, unsigned int array_size,
+                  int timeout, struct MinMax *min_max, bool *timeout_expired) {
+    struct timespec deadline;
+    if (timeout > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout;
+    }
+    *timeout_expired = false;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->array = array;
+    pool->array_size = array_size;
+    pool->finished = 0;
+    atomic_store(&pool->cancel, false);
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+
+    while (pool->finished < pool->threads_num) {
+        if (timeout > 0 && !*timeout_expired) {
+            int err = pthread_cond_timedwait(&pool->done_cond, &pool->mutex,
+                                             &deadline);
+            if (err == ETIMEDOUT && pool->finished < pool->threads_num) {
+                printf("\nTimeout expired! Cancelling worker threads...\n");
+                *timeout_expired = true;
+                atomic_store(&pool->cancel, true);
+            }
+        } else {
+            pthread_cond_wait(&pool->done_cond, &pool->mutex);
+        }
+    }
+
+    min_max->min = INT_MAX;
+    min_max->max = INT_MIN;
+    int results_received = 0;
+    for (int i = 0; i < pool->threads_num; i++) {
+        if (!pool->workers[i].completed) continue;
+        results_received++;
+        if (pool->workers[i].result.min < min_max->min)
+            min_max->min = pool->workers[i].result.min;
+        if (pool->workers[i].result.max > min_max->max)
+            min_max->max = pool->workers[i].result.max;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return results_received;
+}
+
+void MinMaxPoolDestroy(struct MinMaxPool *pool) {
+    if (pool == NULL) return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->threads_num; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,26 @@
+#ifndef MIN_MAX_POOL_H
+#define MIN_MAX_POOL_H
+
+#include <stdbool.h>
+
+#include "utils.h"
+
+// Постоянный пул потоков для поиска минимума и максимума.
+// Потоки создаются один раз и переиспользуются между запросами,
+// массив общий (без копирования, в отличие от fork).
+struct MinMaxPool;
+
+struct MinMaxPool *MinMaxPoolCreate(int threads_num);
+
+// Делит [0, array_size) на threads_num частей и ждет результата.
+// Если timeout > 0 (секунды) и время вышло, выставляет флаг отмены:
+// потоки проверяют его между блоками и выходят досрочно (аналог SIGKILL
+// для процессов). *timeout_expired выставляется в true в этом случае.
+// Возвращает число потоков, успевших обработать свою часть целиком;
+// в *min_max записывается результат только по этим частям.
+int MinMaxPoolRun(struct MinMaxPool *pool, int *array, unsigned int array_size,
+                  int timeout, struct MinMax *min_max, bool *timeout_expired);
+
+void MinMaxPoolDestroy(struct MinMaxPool *pool);
+
+#endif
@@ -8,104 +8,469 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
 
-#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
 #include <getopt.h>
 
 #include "find_min_max.h"
+#include "trace.h"
+#include "min_max_pool.h"
 #include "utils.h"
+#include "work_stealing.h"
+
+// Чем считать: fork на каждую часть, постоянный пул потоков с равными
+// частями или пул с кражей работы
+enum RunMode {
+    MODE_PROCESSES,  // --mode=processes (по умолчанию)
+    MODE_THREADS,    // --mode=threads
+    MODE_STEAL       // --mode=steal
+};
+
+// Размер листовой задачи по умолчанию для --mode=steal
+#define STEAL_DEFAULT_GRAIN (1u << 16)
+
+// Способ передачи результата от дочернего процесса родителю
+enum ResultTransport {
+    TRANSPORT_PIPE,   // по умолчанию
+    TRANSPORT_FILES,  // --by_files
+    TRANSPORT_SHM     // --by_shm
+};
+
+// Слот в общей памяти (mmap MAP_SHARED | MAP_ANONYMOUS) для одного ребенка.
+// Выровнен на кэш-линию, чтобы соседние дети не делили одну линию.
+// ready выставляется после записи result (release), поэтому родитель
+// видит готовые результаты даже если остальных детей убил таймаут.
+struct MinMaxSlot {
+    struct MinMax result;
+    atomic_int ready;
+} __attribute__((aligned(64)));
 
 // Глобальная переменная для хранения PID дочерних процессов
 pid_t *child_pids = NULL;
 int pnum = 0;
 bool timeout_expired = false;
 
-// Обработчик сигнала SIGALRM (таймаут)
-void timeout_handler(int sig) {
+// Таблица pid -> номер ребенка (открытая адресация, линейное пробирование).
+// Нужна, чтобы по pid завершившегося процесса найти его слот за O(1),
+// а не перебором child_pids.
+struct PidMap {
+    pid_t *keys;    // 0 - свободная ячейка
+    int *values;
+    unsigned int mask;
+};
+
+struct PidMap pid_map = {NULL, NULL, 0};
+
+bool PidMapInit(struct PidMap *map, int capacity) {
+    unsigned int size = 16;
+    while (size < 2u * (unsigned int)capacity) size <<= 1;
+    map->keys = calloc(size, sizeof(pid_t));
+    map->values = malloc(size * sizeof(int));
+    map->mask = size - 1;
+    return map->keys != NULL && map->values != NULL;
+}
+
+void PidMapFree(struct PidMap *map) {
+    free(map->keys);
+    free(map->values);
+    map->keys = NULL;
+    map->values = NULL;
+}
+
+static unsigned int PidMapHash(const struct PidMap *map, pid_t pid) {
+    return ((uint32_t)pid * 2654435761u) & map->mask;
+}
+
+void PidMapPut(struct PidMap *map, pid_t pid, int index) {
+    unsigned int pos = PidMapHash(map, pid);
+    while (map->keys[pos] != 0 && map->keys[pos] != pid) {
+        pos = (pos + 1) & map->mask;
+    }
+    map->keys[pos] = pid;
+    map->values[pos] = index;
+}
+
+int PidMapFind(const struct PidMap *map, pid_t pid) {
+    unsigned int pos = PidMapHash(map, pid);
+    while (map->keys[pos] != 0) {
+        if (map->keys[pos] == pid) return map->values[pos];
+        pos = (pos + 1) & map->mask;
+    }
+    return -1;
+}
+
+// Таймаут истек: убиваем всех, кто еще работает
+void kill_remaining_children(void) {
     printf("\nTimeout expired! Sending SIGKILL to all child processes...\n");
     timeout_expired = true;
-    
-    if (child_pids != NULL) {
-        for (int i = 0; i < pnum; i++) {
-            if (child_pids[i] > 0) {
-                kill(child_pids[i], SIGKILL);
+
+    for (int i = 0; i < pnum; i++) {
+        if (child_pids[i] > 0) {
+            kill(child_pids[i], SIGKILL);
+        }
+    }
+}
+
+// Забирает всех уже завершившихся детей, возвращает их количество
+int reap_finished_children(void) {
+    int reaped = 0;
+    while (true) {
+        int status;
+        pid_t finished_pid = waitpid(-1, &status, WNOHANG);
+        if (finished_pid <= 0) {
+            if (finished_pid < 0 && errno != ECHILD) {
+                perror("waitpid error");
             }
+            break;
+        }
+
+        int index = PidMapFind(&pid_map, finished_pid);
+        if (index >= 0) {
+            child_pids[index] = 0;
+            reaped++;
+        }
+
+        if (WIFEXITED(status)) {
+            printf("Child process %d exited with status %d\n", 
+                   finished_pid, WEXITSTATUS(status));
+        } else if (WIFSIGNALED(status)) {
+            printf("Child process %d terminated by signal %d\n", 
+                   finished_pid, WTERMSIG(status));
+        }
+    }
+    return reaped;
+}
+
+static double MonotonicSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Запасной путь, когда epoll/signalfd/timerfd недоступны или сломались:
+// опрос waitpid(WNOHANG) раз в миллисекунду до срока started + timeout,
+// после срока оставшиеся дети убиваются, как и по timerfd
+static void poll_children_until_deadline(int active_children, double started,
+                                         int timeout) {
+    bool killed = false;
+    while (true) {
+        active_children -= reap_finished_children();
+        if (active_children <= 0) break;
+
+        // Детей больше нет (например, их уже забрал кто-то другой):
+        // ждать нечего. WNOWAIT только проверяет, никого не забирая.
+        siginfo_t info;
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0 &&
+            errno == ECHILD) {
+            break;
+        }
+
+        if (timeout > 0 && !killed &&
+            MonotonicSeconds() - started >= timeout) {
+            kill_remaining_children();
+            killed = true;
         }
+        struct timespec pause = {0, 1000000};
+        nanosleep(&pause, NULL);
     }
 }
 
-// Функция для ожидания завершения дочерних процессов с таймаутом
+// Функция для ожидания завершения дочерних процессов с таймаутом.
+// SIGCHLD должен быть заблокирован до fork (см. RunProcesses): тогда он
+// приходит через signalfd, а таймаут через timerfd, и оба ждутся в одном
+// epoll_wait. Процесс просыпается ровно тогда, когда кто-то завершился или
+// истекло время, без опроса раз в миллисекунду.
 void wait_for_children_with_timeout(int timeout) {
+    double started = MonotonicSeconds();
     int active_children = pnum;
-    
+    int epoll_fd = -1;
+    int signal_fd = -1;
+    int timer_fd = -1;
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epoll_fd < 0 || signal_fd < 0) {
+        perror("epoll/signalfd");
+        goto fallback;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = signal_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event) < 0) {
+        perror("epoll_ctl");
+        goto fallback;
+    }
+
     if (timeout > 0) {
-        // Устанавливаем обработчик для SIGALRM
-        signal(SIGALRM, timeout_handler);
-        
-        // Устанавливаем таймер
-        alarm(timeout);
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct itimerspec deadline = {{0, 0}, {timeout, 0}};
+        if (timer_fd < 0 || timerfd_settime(timer_fd, 0, &deadline, NULL) < 0) {
+            perror("timerfd");
+            goto fallback;
+        }
+        event.events = EPOLLIN;
+        event.data.fd = timer_fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event) < 0) {
+            perror("epoll_ctl");
+            goto fallback;
+        }
     }
-    
+
+    // Дети, завершившиеся до создания signalfd
+    active_children -= reap_finished_children();
+
     while (active_children > 0) {
-        int status;
-        pid_t finished_pid = waitpid(-1, &status, WNOHANG);
-        
-        if (finished_pid > 0) {
-            // Один из дочерних процессов завершился
-            active_children--;
-            
-            // Находим и обнуляем PID завершенного процесса
-            for (int i = 0; i < pnum; i++) {
-                if (child_pids[i] == finished_pid) {
-                    child_pids[i] = 0;
-                    break;
+        struct epoll_event events[2];
+        int ready = epoll_wait(epoll_fd, events, 2, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            goto fallback;
+        }
+
+        for (int e = 0; e < ready; e++) {
+            if (events[e].data.fd == signal_fd) {
+                // SIGCHLD склеиваются, поэтому после чтения забираем
+                // всех завершившихся, а не одного
+                struct signalfd_siginfo info[16];
+                while (read(signal_fd, info, sizeof(info)) > 0) {
                 }
+                active_children -= reap_finished_children();
+            } else if (events[e].data.fd == timer_fd) {
+                uint64_t expirations;
+                read(timer_fd, &expirations, sizeof(expirations));
+                kill_remaining_children();
             }
-            
-            if (WIFEXITED(status)) {
-                printf("Child process %d exited with status %d\n", 
-                       finished_pid, WEXITSTATUS(status));
-            } else if (WIFSIGNALED(status)) {
-                printf("Child process %d terminated by signal %d\n", 
-                       finished_pid, WTERMSIG(status));
+        }
+    }
+
+    close(epoll_fd);
+    close(signal_fd);
+    if (timer_fd >= 0) close(timer_fd);
+    return;
+
+fallback:
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (signal_fd >= 0) close(signal_fd);
+    if (timer_fd >= 0) close(timer_fd);
+    poll_children_until_deadline(active_children, started, timeout);
+}
+
+// GetMinMax как редукция для пула с кражей работы
+static void MinMaxLeaf(void *ctx, size_t begin, size_t end, void *partial) {
+    struct TraceSpan scan = TraceBegin("scan");
+    struct MinMax local = GetMinMax((int *)ctx, begin, end);
+    TraceEndArg(scan, end - begin);
+    struct MinMax *min_max = (struct MinMax *)partial;
+    if (local.min < min_max->min) min_max->min = local.min;
+    if (local.max > min_max->max) min_max->max = local.max;
+}
+
+static void MinMaxCombine(void *into, const void *from) {
+    const struct MinMax *part = (const struct MinMax *)from;
+    struct MinMax *min_max = (struct MinMax *)into;
+    if (part->min < min_max->min) min_max->min = part->min;
+    if (part->max > min_max->max) min_max->max = part->max;
+}
+
+// Один запуск в режиме процессов: fork на каждую часть массива,
+// результаты через pipe, файлы или общую память. Возвращает число полученных
+// результатов или -1 при ошибке.
+int RunProcesses(int *array, int array_size, enum ResultTransport transport,
+                 int timeout, struct MinMax *min_max) {
+    // Массивы для pipe или имен файлов
+    int pipes[2 * pnum];
+    char filenames[pnum][50];
+    struct MinMaxSlot *slots = NULL;
+    size_t slots_size = sizeof(struct MinMaxSlot) * pnum;
+
+    timeout_expired = false;
+
+    // Подготовка коммуникационных каналов
+    if (transport == TRANSPORT_SHM) {
+        // Анонимное отображение обнулено ядром, т.е. все ready == 0
+        slots = mmap(NULL, slots_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (slots == MAP_FAILED) {
+            printf("Shared memory mapping failed!\n");
+            return -1;
+        }
+    } else if (transport == TRANSPORT_PIPE) {
+        for (int i = 0; i < pnum; i++) {
+            if (pipe(pipes + i * 2) < 0) {
+                printf("Pipe creation failed!\n");
+                return -1;
             }
-            
-        } else if (finished_pid == 0) {
-            // Дочерние процессы еще работают
-            if (timeout_expired) {
-                // Таймаут истек, процессы были убиты
-                // Ждем их окончательного завершения
-                sleep(1);
+        }
+    }
+
+    if (!PidMapInit(&pid_map, pnum)) {
+        printf("Memory allocation failed for pid map\n");
+        PidMapFree(&pid_map);
+        if (slots != NULL) munmap(slots, slots_size);
+        return -1;
+    }
+
+    // SIGCHLD блокируется до fork, чтобы ни одно завершение не потерялось
+    // до создания signalfd в wait_for_children_with_timeout
+    sigset_t chld_mask, old_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &old_mask);
+
+    // Сбрасываем буфер stdout, иначе дочерние процессы напечатают его повторно
+    fflush(stdout);
+
+    // Создание дочерних процессов
+    struct TraceSpan forks = TraceBegin("fork");
+    for (int i = 0; i < pnum; i++) {
+        pid_t pid = fork();
+        
+        if (pid >= 0) {
+            if (pid == 0) {
+                // ДОЧЕРНИЙ ПРОЦЕСС
+                sigprocmask(SIG_SETMASK, &old_mask, NULL);
+                
+                // Вычисление границ части массива
+                int chunk_size = array_size / pnum;
+                int start = i * chunk_size;
+                int end = (i == pnum - 1) ? array_size : (i + 1) * chunk_size;
+                
+                // Поиск минимума и максимума в своей части
+                struct TraceSpan scan = TraceBegin("scan");
+                struct MinMax local_min_max = GetMinMax(array, start, end);
+                TraceEndArg(scan, end - start);
+
+                struct TraceSpan publish = TraceBegin("publish result");
+                
+                if (transport == TRANSPORT_SHM) {
+                    // Использование общей памяти: без системных вызовов
+                    slots[i].result = local_min_max;
+                    atomic_store_explicit(&slots[i].ready, 1,
+                                          memory_order_release);
+                } else if (transport == TRANSPORT_FILES) {
+                    // Использование файлов
+                    sprintf(filenames[i], "min_max_%d.txt", i);
+                    FILE *file = fopen(filenames[i], "w");
+                    if (file != NULL) {
+                        fprintf(file, "%d %d", local_min_max.min, local_min_max.max);
+                        fclose(file);
+                    }
+                } else {
+                    // Использование pipe
+                    close(pipes[i * 2]);
+                    write(pipes[i * 2 + 1], &local_min_max.min, sizeof(int));
+                    write(pipes[i * 2 + 1], &local_min_max.max, sizeof(int));
+                    close(pipes[i * 2 + 1]);
+                }
+                TraceEnd(publish);
+                
+                free(array);
+                exit(0);
+                
             } else {
-                // Даем процессорам время для работы
-                usleep(1000); // 1 миллисекунда
+                // РОДИТЕЛЬСКИЙ ПРОЦЕСС
+                child_pids[i] = pid;
+                PidMapPut(&pid_map, pid, i);
             }
+            
         } else {
-            // Ошибка waitpid
-            if (errno == ECHILD) {
-                // Нет дочерних процессов
-                break;
-            }
-            perror("waitpid error");
-            break;
+            printf("Fork failed!\n");
+            sigprocmask(SIG_SETMASK, &old_mask, NULL);
+            PidMapFree(&pid_map);
+            if (slots != NULL) munmap(slots, slots_size);
+            return -1;
         }
     }
-    
-    // Отключаем таймер, если он еще не сработал
+
+    TraceEndArg(forks, pnum);
+
+    // Ожидание завершения дочерних процессов с возможным таймаутом
+    printf("Parent process waiting for %d child processes", pnum);
     if (timeout > 0) {
-        alarm(0);
+        printf(" (timeout: %d seconds)", timeout);
+    }
+    printf("...\n");
+    
+    struct TraceSpan wait = TraceBegin("wait children");
+    wait_for_children_with_timeout(timeout);
+    TraceEnd(wait);
+
+    // Возвращаем исходную маску сигналов
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    PidMapFree(&pid_map);
+
+    // Сбор результатов
+    min_max->min = INT_MAX;
+    min_max->max = INT_MIN;
+
+    int results_received = 0;
+    struct TraceSpan collect = TraceBegin("collect results");
+    for (int i = 0; i < pnum; i++) {
+        int min = INT_MAX;
+        int max = INT_MIN;
+
+        if (transport == TRANSPORT_SHM) {
+            if (atomic_load_explicit(&slots[i].ready, memory_order_acquire)) {
+                min = slots[i].result.min;
+                max = slots[i].result.max;
+                results_received++;
+            }
+        } else if (transport == TRANSPORT_FILES) {
+            sprintf(filenames[i], "min_max_%d.txt", i);
+            FILE *file = fopen(filenames[i], "r");
+            if (file != NULL) {
+                if (fscanf(file, "%d %d", &min, &max) == 2) {
+                    results_received++;
+                }
+                fclose(file);
+                remove(filenames[i]);
+            }
+        } else {
+            close(pipes[i * 2 + 1]);
+            struct TraceSpan pipe_read = TraceBegin("pipe read");
+            if (read(pipes[i * 2], &min, sizeof(int)) > 0 &&
+                read(pipes[i * 2], &max, sizeof(int)) > 0) {
+                results_received++;
+            }
+            TraceEndArg(pipe_read, i);
+            close(pipes[i * 2]);
+        }
+
+        if (min < min_max->min) min_max->min = min;
+        if (max > min_max->max) min_max->max = max;
     }
+
+    TraceEnd(collect);
+    if (slots != NULL) munmap(slots, slots_size);
+
+    return results_received;
 }
 
 int main(int argc, char **argv) {
     int seed = -1;
     int array_size = -1;
     int timeout = 0;  // 0 означает "нет таймаута"
-    bool with_files = false;
+    enum ResultTransport transport = TRANSPORT_PIPE;
+    enum RunMode mode = MODE_PROCESSES;
+    int repeat = 1;  // число повторных запросов к тому же массиву
+    int grain = STEAL_DEFAULT_GRAIN;
+    const char *trace_path = NULL;  // Chrome trace JSON, если задан
 
     // Разбор аргументов командной строки
     while (true) {
@@ -117,11 +482,16 @@ int main(int argc, char **argv) {
             {"pnum", required_argument, 0, 0},
             {"timeout", required_argument, 0, 0},
             {"by_files", no_argument, 0, 'f'},
+            {"by_shm", no_argument, 0, 's'},
+            {"mode", required_argument, 0, 0},
+            {"repeat", required_argument, 0, 0},
+            {"grain", required_argument, 0, 0},
+            {"trace", required_argument, 0, 0},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        int c = getopt_long(argc, argv, "f", options, &option_index);
+        int c = getopt_long(argc, argv, "fs", options, &option_index);
 
         if (c == -1) break;
 
@@ -158,14 +528,49 @@ int main(int argc, char **argv) {
                         printf("Timeout set to %d seconds\n", timeout);
                         break;
                     case 4:
-                        with_files = true;
+                        transport = TRANSPORT_FILES;
+                        break;
+                    case 5:
+                        transport = TRANSPORT_SHM;
+                        break;
+                    case 6:
+                        if (strcmp(optarg, "threads") == 0) {
+                            mode = MODE_THREADS;
+                        } else if (strcmp(optarg, "processes") == 0) {
+                            mode = MODE_PROCESSES;
+                        } else if (strcmp(optarg, "steal") == 0) {
+                            mode = MODE_STEAL;
+                        } else {
+                            printf("mode must be \"processes\", \"threads\" or \"steal\"\n");
+                            return 1;
+                        }
+                        break;
+                    case 7:
+                        repeat = atoi(optarg);
+                        if (repeat <= 0) {
+                            printf("repeat must be a positive number\n");
+                            return 1;
+                        }
+                        break;
+                    case 8:
+                        grain = atoi(optarg);
+                        if (grain <= 0) {
+                            printf("grain must be a positive number\n");
+                            return 1;
+                        }
+                        break;
+                    case 9:
+                        trace_path = optarg;
                         break;
                     default:
                         printf("Index %d is out of options\n", option_index);
                 }
                 break;
             case 'f':
-                with_files = true;
+                transport = TRANSPORT_FILES;
+                break;
+            case 's':
+                transport = TRANSPORT_SHM;
                 break;
             case '?':
                 break;
@@ -180,12 +585,19 @@ int main(int argc, char **argv) {
     }
 
     // Проверка обязательных аргументов
-    if (seed == -1 || array_size == -1 || pnum == -1) {
-        printf("Usage: %s --seed \"num\" --array_size \"num\" --pnum \"num\" [--timeout \"num\"] [--by_files]\n",
+    if (seed == -1 || array_size == -1 || pnum <= 0) {
+        printf("Usage: %s --seed \"num\" --array_size \"num\" --pnum \"num\" [--timeout \"num\"] [--by_files|--by_shm]"
+               " [--mode=processes|threads|steal] [--repeat \"num\"] [--grain \"num\"]"
+               " [--trace \"file.json\"]\n",
                argv[0]);
         return 1;
     }
 
+    if (mode == MODE_STEAL && timeout > 0) {
+        printf("--timeout is not supported with --mode=steal\n");
+        return 1;
+    }
+
     // Выделение памяти для хранения PID дочерних процессов
     child_pids = malloc(pnum * sizeof(pid_t));
     if (child_pids == NULL) {
@@ -193,149 +605,116 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    // До создания потоков и fork: все они пишут события в общий файл
+    TraceInit(trace_path);
+    TraceSetThreadName("main");
+
     // Генерация массива
     int *array = malloc(sizeof(int) * array_size);
+    struct TraceSpan generate = TraceBegin("generate");
     GenerateArray(array, array_size, seed);
+    double generate_time = TraceEndMs(generate);
 
-    // Массивы для pipe или имен файлов
-    int pipes[2 * pnum];
-    char filenames[pnum][50];
-
-    // Подготовка коммуникационных каналов
-    if (!with_files) {
-        for (int i = 0; i < pnum; i++) {
-            if (pipe(pipes + i * 2) < 0) {
-                printf("Pipe creation failed!\n");
-                free(array);
-                free(child_pids);
-                return 1;
-            }
-        }
-    }
-
-    // Начало отсчета времени
-    struct timeval start_time;
-    gettimeofday(&start_time, NULL);
+    const char *mode_names[] = {"processes", "threads", "steal"};
+    const char *mode_name = mode_names[mode];
+    struct MinMaxPool *pool = NULL;
+    struct WsPool *steal_pool = NULL;
+    double pool_start_time = 0;
 
-    // Создание дочерних процессов
-    for (int i = 0; i < pnum; i++) {
-        pid_t pid = fork();
-        
-        if (pid >= 0) {
-            if (pid == 0) {
-                // ДОЧЕРНИЙ ПРОЦЕСС
-                
-                // Вычисление границ части массива
-                int chunk_size = array_size / pnum;
-                int start = i * chunk_size;
-                int end = (i == pnum - 1) ? array_size : (i + 1) * chunk_size;
-                
-                // Поиск минимума и максимума в своей части
-                struct MinMax local_min_max = GetMinMax(array, start, end);
-                
-                if (with_files) {
-                    // Использование файлов
-                    sprintf(filenames[i], "min_max_%d.txt", i);
-                    FILE *file = fopen(filenames[i], "w");
-                    if (file != NULL) {
-                        fprintf(file, "%d %d", local_min_max.min, local_min_max.max);
-                        fclose(file);
-                    }
-                } else {
-                    // Использование pipe
-                    close(pipes[i * 2]);
-                    write(pipes[i * 2 + 1], &local_min_max.min, sizeof(int));
-                    write(pipes[i * 2 + 1], &local_min_max.max, sizeof(int));
-                    close(pipes[i * 2 + 1]);
-                }
-                
-                free(array);
-                exit(0);
-                
-            } else {
-                // РОДИТЕЛЬСКИЙ ПРОЦЕСС
-                child_pids[i] = pid;
-            }
-            
+    // Пул создается один раз и переиспользуется всеми повторами
+    if (mode != MODE_PROCESSES) {
+        struct TraceSpan pool_start = TraceBegin("pool start");
+        if (mode == MODE_THREADS) {
+            pool = MinMaxPoolCreate(pnum);
         } else {
-            printf("Fork failed!\n");
+            steal_pool = WsPoolCreate(pnum);
+        }
+        if (pool == NULL && steal_pool == NULL) {
+            printf("Thread pool creation failed!\n");
             free(array);
             free(child_pids);
             return 1;
         }
+        pool_start_time = TraceEndMs(pool_start);
     }
 
-    // Ожидание завершения дочерних процессов с возможным таймаутом
-    printf("Parent process waiting for %d child processes", pnum);
-    if (timeout > 0) {
-        printf(" (timeout: %d seconds)", timeout);
-    }
-    printf("...\n");
-    
-    wait_for_children_with_timeout(timeout);
-
-    // Сбор результатов
     struct MinMax min_max;
-    min_max.min = INT_MAX;
-    min_max.max = INT_MIN;
-
     int results_received = 0;
-    for (int i = 0; i < pnum; i++) {
-        int min = INT_MAX;
-        int max = INT_MIN;
+    bool any_timeout = false;
 
-        if (with_files) {
-            sprintf(filenames[i], "min_max_%d.txt", i);
-            FILE *file = fopen(filenames[i], "r");
-            if (file != NULL) {
-                if (fscanf(file, "%d %d", &min, &max) == 2) {
-                    results_received++;
-                }
-                fclose(file);
-                remove(filenames[i]);
-            }
+    // Начало отсчета времени
+    struct TraceSpan total = TraceBegin("total");
+
+    const struct MinMax min_max_identity = {INT_MAX, INT_MIN};
+    const struct WsReduction min_max_reduction = {
+        MinMaxLeaf, MinMaxCombine, &min_max_identity, sizeof(struct MinMax)};
+
+    for (int r = 0; r < repeat; r++) {
+        struct TraceSpan run = TraceBegin("run");
+        if (mode == MODE_THREADS) {
+            results_received = MinMaxPoolRun(pool, array, array_size, timeout,
+                                             &min_max, &timeout_expired);
+        } else if (mode == MODE_STEAL) {
+            WsPoolReduce(steal_pool, 0, array_size, grain, &min_max_reduction,
+                         array, &min_max);
+            results_received = pnum;
         } else {
-            close(pipes[i * 2 + 1]);
-            if (read(pipes[i * 2], &min, sizeof(int)) > 0 &&
-                read(pipes[i * 2], &max, sizeof(int)) > 0) {
-                results_received++;
-            }
-            close(pipes[i * 2]);
+            results_received = RunProcesses(array, array_size, transport,
+                                            timeout, &min_max);
         }
-
-        if (min < min_max.min) min_max.min = min;
-        if (max > min_max.max) min_max.max = max;
+        if (results_received < 0) {
+            MinMaxPoolDestroy(pool);
+            WsPoolDestroy(steal_pool);
+            free(array);
+            free(child_pids);
+            return 1;
+        }
+        any_timeout = any_timeout || timeout_expired;
+        TraceEndArg(run, r);
     }
 
     // Конец отсчета времени
-    struct timeval finish_time;
-    gettimeofday(&finish_time, NULL);
+    double elapsed_time = TraceEndMs(total);
 
-    double elapsed_time = (finish_time.tv_sec - start_time.tv_sec) * 1000.0;
-    elapsed_time += (finish_time.tv_usec - start_time.tv_usec) / 1000.0;
+    unsigned long steals = steal_pool != NULL ? WsPoolSteals(steal_pool) : 0;
+    MinMaxPoolDestroy(pool);
+    WsPoolDestroy(steal_pool);
 
     // Вывод результатов
     printf("\n=== Results ===\n");
-    printf("Results received from %d out of %d processes\n", results_received, pnum);
+    printf("Mode: %s, kernel: %s\n", mode_name, GetMinMaxKernelName());
+    printf("Results received from %d out of %d %s\n", results_received, pnum,
+           mode_name);
     
-    if (timeout_expired) {
-        printf("WARNING: Timeout expired! Some processes were terminated.\n");
+    if (any_timeout) {
+        printf("WARNING: Timeout expired! Some %s were terminated.\n", mode_name);
     }
     
     if (results_received > 0) {
         printf("Min: %d\n", min_max.min);
         printf("Max: %d\n", min_max.max);
     } else {
-        printf("No results received (all processes may have been terminated)\n");
+        printf("No results received (all %s may have been terminated)\n", mode_name);
         min_max.min = 0;
         min_max.max = 0;
     }
     
-    printf("Elapsed time: %.2fms\n", elapsed_time);
+    if (mode != MODE_PROCESSES) {
+        printf("Pool start time: %.2fms\n", pool_start_time);
+    }
+    if (mode == MODE_STEAL) {
+        printf("Grain: %d, steals in last run: %lu\n", grain, steals);
+    }
+    printf("Generate time: %.2fms\n", generate_time);
+    printf("Elapsed time (%s): %.2fms\n", mode_name, elapsed_time);
+    if (repeat > 1) {
+        printf("Per query (%s, %d runs): %.3fms\n", mode_name, repeat,
+               elapsed_time / repeat);
+    }
 
     // Освобождение памяти
     free(array);
     free(child_pids);
 
     return 0;
-}
\ No newline at end of file
+}
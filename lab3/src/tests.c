@@ -0,0 +1,144 @@
+#include <CUnit/Basic.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "find_min_max.h"
+
+#define TEST_SIZE 133
+#define TEST_MAX_OFFSET 16
+
+typedef struct MinMax (*GetMinMaxFunc)(int *, unsigned int, unsigned int);
+
+static int buffer[TEST_SIZE + TEST_MAX_OFFSET] __attribute__((aligned(64)));
+
+// Сравнивает реализацию со скалярной на всех промежутках [begin, end),
+// 0 <= begin <= end <= TEST_SIZE, при всех сдвигах массива относительно
+// 64-байтной границы, чтобы задеть все варианты головы и хвоста.
+static void CheckAgainstScalar(GetMinMaxFunc func) {
+  for (int offset = 0; offset < TEST_MAX_OFFSET; offset++) {
+    int *array = buffer + offset;
+    for (unsigned int begin = 0; begin <= TEST_SIZE; begin++) {
+      for (unsigned int end = begin; end <= TEST_SIZE; end++) {
+        struct MinMax expected = GetMinMaxScalar(array, begin, end);
+        struct MinMax actual = func(array, begin, end);
+        if (expected.min != actual.min || expected.max != actual.max) {
+          printf("\nmismatch: offset=%d begin=%u end=%u\n", offset, begin,
+                 end);
+          CU_FAIL_FATAL("result differs from scalar GetMinMax");
+        }
+      }
+    }
+  }
+  CU_PASS("all ranges match");
+}
+
+static void FillRandom(void) {
+  srand(42);
+  for (int i = 0; i < TEST_SIZE + TEST_MAX_OFFSET; i++) {
+    buffer[i] = rand() - RAND_MAX / 2;
+  }
+  // Крайние значения в голове, середине и хвосте.
+  buffer[3] = INT_MIN;
+  buffer[TEST_SIZE / 2] = INT_MAX;
+  buffer[TEST_SIZE + TEST_MAX_OFFSET - 2] = INT_MIN;
+}
+
+void testScalar(void) {
+  int array[] = {1, 2, 8, 5, 4, 3, 7, 9, 6};
+
+  struct MinMax result = GetMinMaxScalar(array, 2, 7);
+  CU_ASSERT_EQUAL(result.min, 3);
+  CU_ASSERT_EQUAL(result.max, 8);
+
+  result = GetMinMaxScalar(array, 0, 9);
+  CU_ASSERT_EQUAL(result.min, 1);
+  CU_ASSERT_EQUAL(result.max, 9);
+
+  result = GetMinMaxScalar(array, 4, 4);
+  CU_ASSERT_EQUAL(result.min, INT_MAX);
+  CU_ASSERT_EQUAL(result.max, INT_MIN);
+}
+
+void testDispatched(void) { CheckAgainstScalar(GetMinMax); }
+
+#ifdef FIND_MIN_MAX_X86
+void testSSE41(void) {
+  if (!__builtin_cpu_supports("sse4.1")) return;
+  CheckAgainstScalar(GetMinMaxSSE41);
+}
+
+void testAVX2(void) {
+  if (!__builtin_cpu_supports("avx2")) return;
+  CheckAgainstScalar(GetMinMaxAVX2);
+}
+
+void testAVX512(void) {
+  if (!__builtin_cpu_supports("avx512f")) return;
+  CheckAgainstScalar(GetMinMaxAVX512);
+}
+#endif
+
+// Массив не должен зависеть от числа потоков, которые его заполняют
+void testGenerateArray(void) {
+  const size_t size = (1u << 20) + 7;
+  int *single = malloc(size * sizeof(int));
+  int *multi = malloc(size * sizeof(int));
+  CU_ASSERT_TRUE_FATAL(single != NULL && multi != NULL);
+
+  GenerateArrayTyped(single, size, 42, ARRAY_INT32, 1);
+  GenerateArrayTyped(multi, size, 42, ARRAY_INT32, 3);
+  CU_ASSERT_TRUE(memcmp(single, multi, size * sizeof(int)) == 0);
+
+  GenerateArray(multi, size, 42);
+  CU_ASSERT_TRUE(memcmp(single, multi, size * sizeof(int)) == 0);
+
+  GenerateArray(multi, size, 43);
+  CU_ASSERT_TRUE(memcmp(single, multi, size * sizeof(int)) != 0);
+
+  int negative = 0;
+  for (size_t i = 0; i < size; i++) negative += single[i] < 0;
+  CU_ASSERT_EQUAL(negative, 0);
+
+  free(single);
+  free(multi);
+}
+
+int main() {
+  CU_pSuite pSuite = NULL;
+
+  FillRandom();
+  printf("GetMinMax kernel: %s\n", GetMinMaxKernelName());
+
+  /* initialize the CUnit test registry */
+  if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+  /* add a suite to the registry */
+  pSuite = CU_add_suite("Suite", NULL, NULL);
+  if (NULL == pSuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* add the tests to the suite */
+  if ((NULL == CU_add_test(pSuite, "test of GetMinMaxScalar", testScalar)) ||
+      (NULL == CU_add_test(pSuite, "test of GetMinMax", testDispatched)) ||
+      (NULL == CU_add_test(pSuite, "test of GenerateArray", testGenerateArray))
+#ifdef FIND_MIN_MAX_X86
+      || (NULL == CU_add_test(pSuite, "test of GetMinMaxSSE41", testSSE41)) ||
+      (NULL == CU_add_test(pSuite, "test of GetMinMaxAVX2", testAVX2)) ||
+      (NULL == CU_add_test(pSuite, "test of GetMinMaxAVX512", testAVX512))
+#endif
+  ) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Run all tests using the CUnit Basic interface */
+  CU_basic_set_mode(CU_BRM_VERBOSE);
+  CU_basic_run_tests();
+  unsigned int failures = CU_get_number_of_failures();
+  CU_cleanup_registry();
+  return failures ? 1 : CU_get_error();
+}
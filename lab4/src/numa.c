@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+#include "numa.h"
+
+#include <dirent.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define NUMA_SYSFS "/sys/devices/system/node"
+#define NUMA_MPOL_BIND 2
+
+// Разбирает строку вида "0-3,8,10-11" и добавляет процессоры в топологию
+static void ParseCpuList(struct NumaTopology *topology, const char *list,
+                         int node, int max_cpus) {
+    const char *p = list;
+    while (*p != '\0' && *p != '\n') {
+        char *end = NULL;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) break;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && topology->cpus_num < max_cpus; cpu++) {
+            topology->cpu_ids[topology->cpus_num] = (int)cpu;
+            topology->cpu_nodes[topology->cpus_num] = node;
+            topology->cpus_num++;
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+}
+
+bool NumaTopologyLoad(struct NumaTopology *topology) {
+    long max_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (max_cpus <= 0) max_cpus = 1;
+
+    topology->nodes_num = 0;
+    topology->cpus_num = 0;
+    topology->cpu_ids = malloc(sizeof(int) * max_cpus);
+    topology->cpu_nodes = malloc(sizeof(int) * max_cpus);
+    if (topology->cpu_ids == NULL || topology->cpu_nodes == NULL) {
+        NumaTopologyFree(topology);
+        return false;
+    }
+
+    // Узлы нумеруются подряд, идем по node0, node1, ... пока они есть
+    for (int node = 0; topology->cpus_num < max_cpus; node++) {
+        char path[128];
+        snprintf(path, sizeof(path), NUMA_SYSFS "/node%d/cpulist", node);
+        FILE *file = fopen(path, "r");
+        if (file == NULL) break;
+
+        char list[4096];
+        if (fgets(list, sizeof(list), file) != NULL) {
+            ParseCpuList(topology, list, node, (int)max_cpus);
+        }
+        fclose(file);
+        topology->nodes_num = node + 1;
+    }
+
+    if (topology->cpus_num == 0) {
+        // Нет sysfs: один узел со всеми процессорами
+        topology->nodes_num = 1;
+        for (long cpu = 0; cpu < max_cpus; cpu++) {
+            topology->cpu_ids[cpu] = (int)cpu;
+            topology->cpu_nodes[cpu] = 0;
+        }
+        topology->cpus_num = (int)max_cpus;
+    }
+
+    return true;
+}
+
+void NumaTopologyFree(struct NumaTopology *topology) {
+    free(topology->cpu_ids);
+    free(topology->cpu_nodes);
+    topology->cpu_ids = NULL;
+    topology->cpu_nodes = NULL;
+}
+
+int NumaPinSelf(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+int NumaBindRange(void *addr, size_t size, int node) {
+#ifdef SYS_mbind
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)addr + page - 1) & ~(uintptr_t)(page - 1);
+    uintptr_t end = ((uintptr_t)addr + size) & ~(uintptr_t)(page - 1);
+    if (end <= begin || node >= (int)(sizeof(unsigned long) * 8)) return -1;
+
+    unsigned long nodemask = 1UL << node;
+    return (int)syscall(SYS_mbind, (void *)begin, end - begin, NUMA_MPOL_BIND,
+                        &nodemask, sizeof(nodemask) * 8 + 1, 0);
+#else
+    (void)addr;
+    (void)size;
+    (void)node;
+    return -1;
+#endif
+}
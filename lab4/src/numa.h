@@ -0,0 +1,29 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Топология NUMA, прочитанная из /sys/devices/system/node.
+// Процессоры перечислены подряд по узлам: сначала все CPU узла 0,
+// потом узла 1 и т.д. Если sysfs недоступен, считается, что узел один.
+struct NumaTopology {
+    int nodes_num;
+    int cpus_num;
+    int *cpu_ids;    // номер CPU
+    int *cpu_nodes;  // узел этого CPU
+};
+
+bool NumaTopologyLoad(struct NumaTopology *topology);
+void NumaTopologyFree(struct NumaTopology *topology);
+
+// Привязывает вызывающий поток к процессору cpu
+int NumaPinSelf(int cpu);
+
+// Просит ядро размещать страницы, целиком лежащие в [addr, addr + size),
+// на узле node (mbind MPOL_BIND). Возвращает 0 или -1, если mbind недоступен;
+// тогда остается обычное размещение по первому касанию.
+int NumaBindRange(void *addr, size_t size, int node);
+
+#endif
@@ -1,19 +1,232 @@
+#include <inttypes.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <sys/mman.h>
 #include <getopt.h>
 #include <pthread.h>
 
+#include "numa.h"
 #include "utils.h"
 #include "sum.h"
+#include "trace.h"
+#include "work_stealing.h"
+
+// Размер листовой задачи по умолчанию для --work_stealing
+#define STEAL_DEFAULT_GRAIN (1 << 16)
+
+// Аргументы потока в режиме --numa
+struct NumaSumArgs {
+    struct SumArgs sum;
+    uint32_t seed;
+    int cpu;
+    int node;
+    pthread_barrier_t *ready;  // все части заполнены, можно считать
+    int64_t result;
+    double elapsed_ms;         // время Sum на своей части
+};
+
+// Поток --numa: привязывается к своему CPU, размещает свою часть массива на
+// локальном узле (mbind + первое касание при генерации) и считает сумму.
+void *ThreadNumaSum(void *args) {
+    struct NumaSumArgs *numa_args = (struct NumaSumArgs *)args;
+    struct SumArgs *sum_args = &numa_args->sum;
+
+    NumaPinSelf(numa_args->cpu);
+    NumaBindRange(sum_args->array + sum_args->begin,
+                  sizeof(int) * (sum_args->end - sum_args->begin),
+                  numa_args->node);
+    struct TraceSpan generate = TraceBegin("generate");
+    GenerateArrayRange(sum_args->array, sum_args->begin, sum_args->end,
+                       numa_args->seed);
+    TraceEndArg(generate, numa_args->node);
+
+    pthread_barrier_wait(numa_args->ready);
+
+    struct TraceSpan sum = TraceBegin("sum");
+    numa_args->result = Sum(sum_args);
+    numa_args->elapsed_ms = TraceEndMs(sum);
+
+    return NULL;
+}
+
+// Режим --numa: потоки раскладываются по CPU узел за узлом, каждый сам
+// заполняет свою часть. Возвращает сумму, время выводит по узлам.
+int RunNumaSum(int *array, uint32_t array_size, uint32_t threads_num,
+               uint32_t seed, int64_t *total_sum, double *elapsed_time) {
+    struct NumaTopology topology;
+    if (!NumaTopologyLoad(&topology)) {
+        fprintf(stderr, "Can not read NUMA topology\n");
+        return 1;
+    }
+
+    struct NumaSumArgs args[threads_num];
+    pthread_t threads[threads_num];
+    pthread_barrier_t ready;
+    pthread_barrier_init(&ready, NULL, threads_num + 1);
+
+    int chunk_size = array_size / threads_num;
+    for (uint32_t i = 0; i < threads_num; i++) {
+        // Соседние части попадают на соседние CPU одного узла
+        int slot = (int)((uint64_t)i * topology.cpus_num / threads_num);
+        args[i].sum.array = array;
+        args[i].sum.begin = i * chunk_size;
+        args[i].sum.end = (i == threads_num - 1) ? array_size : (i + 1) * chunk_size;
+        args[i].seed = seed;
+        args[i].cpu = topology.cpu_ids[slot];
+        args[i].node = topology.cpu_nodes[slot];
+        args[i].ready = &ready;
+
+        if (pthread_create(&threads[i], NULL, ThreadNumaSum, (void *)&args[i]) != 0) {
+            fprintf(stderr, "Error: pthread_create failed!\n");
+            exit(1);
+        }
+    }
+
+    // Ждем, пока все заполнят свои части, и только потом засекаем время
+    pthread_barrier_wait(&ready);
+    struct TraceSpan total = TraceBegin("total");
+
+    struct TraceSpan join = TraceBegin("join");
+    *total_sum = 0;
+    for (uint32_t i = 0; i < threads_num; i++) {
+        if (pthread_join(threads[i], NULL) != 0) {
+            fprintf(stderr, "Error: pthread_join failed!\n");
+            exit(1);
+        }
+        *total_sum += args[i].result;
+    }
+    TraceEnd(join);
+    *elapsed_time = TraceEndMs(total);
+
+    // Пропускная способность по узлам: байты узла / время самого медленного
+    // потока узла
+    printf("\n=== NUMA nodes: %d, CPUs: %d ===\n", topology.nodes_num,
+           topology.cpus_num);
+    for (int node = 0; node < topology.nodes_num; node++) {
+        double bytes = 0;
+        double slowest = 0;
+        int node_threads = 0;
+        for (uint32_t i = 0; i < threads_num; i++) {
+            if (args[i].node != node) continue;
+            bytes += sizeof(int) * (double)(args[i].sum.end - args[i].sum.begin);
+            if (args[i].elapsed_ms > slowest) slowest = args[i].elapsed_ms;
+            node_threads++;
+        }
+        if (node_threads == 0) continue;
+        printf("Node %d: %d threads, %.1f MB, %.2f ms, %.2f GB/s\n", node,
+               node_threads, bytes / 1e6, slowest,
+               slowest > 0 ? bytes / (slowest * 1e6) : 0.0);
+    }
+
+    pthread_barrier_destroy(&ready);
+    NumaTopologyFree(&topology);
+    return 0;
+}
+
+// ThreadSum из sum.c, отмеченный на трассе своего потока
+static void *ThreadTracedSum(void *args) {
+    struct SumArgs *sum_args = (struct SumArgs *)args;
+    struct TraceSpan sum = TraceBegin("sum");
+    void *result = ThreadSum(args);
+    TraceEndArg(sum, sum_args->end - sum_args->begin);
+    return result;
+}
+
+// Обычный режим: равные части, по потоку на часть
+int RunStaticSum(int *array, uint32_t array_size, uint32_t threads_num,
+                 int64_t *total_sum, double *elapsed_time) {
+    // Подготовка аргументов для потоков
+    struct SumArgs args[threads_num];
+    pthread_t threads[threads_num];
+    
+    // Разделение массива между потоками
+    int chunk_size = array_size / threads_num;
+    for (uint32_t i = 0; i < threads_num; i++) {
+        args[i].array = array;
+        args[i].begin = i * chunk_size;
+        args[i].end = (i == threads_num - 1) ? array_size : (i + 1) * chunk_size;
+    }
+    
+    // Начало отсчета времени
+    struct TraceSpan total = TraceBegin("total");
+    
+    // Создание потоков
+    struct TraceSpan create = TraceBegin("create threads");
+    for (uint32_t i = 0; i < threads_num; i++) {
+        if (pthread_create(&threads[i], NULL, ThreadTracedSum, (void *)&args[i]) != 0) {
+            fprintf(stderr, "Error: pthread_create failed!\n");
+            return 1;
+        }
+    }
+    TraceEndArg(create, threads_num);
+    
+    // Ожидание завершения потоков и сбор результатов
+    // Частичные суммы 64-битные и приходят по значению (см. ThreadSum)
+    struct TraceSpan join = TraceBegin("join");
+    *total_sum = 0;
+    for (uint32_t i = 0; i < threads_num; i++) {
+        void *thread_sum = NULL;
+        if (pthread_join(threads[i], &thread_sum) != 0) {
+            fprintf(stderr, "Error: pthread_join failed!\n");
+            return 1;
+        }
+        *total_sum += (int64_t)(intptr_t)thread_sum;
+    }
+    TraceEnd(join);
+    
+    // Конец отсчета времени
+    *elapsed_time = TraceEndMs(total);
+
+    return 0;
+}
+
+// Sum как редукция для пула с кражей работы
+static void SumLeaf(void *ctx, size_t begin, size_t end, void *partial) {
+    struct SumArgs args = {(int *)ctx, (int)begin, (int)end};
+    struct TraceSpan sum = TraceBegin("sum");
+    *(int64_t *)partial += Sum(&args);
+    TraceEndArg(sum, end - begin);
+}
+
+static void SumCombine(void *into, const void *from) {
+    *(int64_t *)into += *(const int64_t *)from;
+}
+
+// Режим --work_stealing: массив делится на задачи по grain элементов,
+// освободившиеся потоки забирают работу у занятых
+int RunStealSum(int *array, uint32_t array_size, uint32_t threads_num,
+                int grain, int64_t *total_sum, double *elapsed_time) {
+    struct WsPool *pool = WsPoolCreate(threads_num);
+    if (pool == NULL) {
+        fprintf(stderr, "Error: work stealing pool creation failed!\n");
+        return 1;
+    }
+
+    const int64_t zero = 0;
+    const struct WsReduction reduction = {SumLeaf, SumCombine, &zero,
+                                          sizeof(int64_t)};
+
+    struct TraceSpan total = TraceBegin("total");
+    WsPoolReduce(pool, 0, array_size, grain, &reduction, array, total_sum);
+    *elapsed_time = TraceEndMs(total);
+
+    printf("Work stealing: grain %d, steals %lu\n", grain, WsPoolSteals(pool));
+    WsPoolDestroy(pool);
+    return 0;
+}
 
 int main(int argc, char **argv) {
     // Параметры по умолчанию
     uint32_t threads_num = 0;
     uint32_t array_size = 0;
     uint32_t seed = 0;
+    bool numa = false;
+    bool work_stealing = false;
+    int grain = STEAL_DEFAULT_GRAIN;
+    const char *trace_path = NULL;  // Chrome trace JSON, если задан
     
     // Парсинг аргументов командной строки
     while (1) {
@@ -21,6 +234,10 @@ int main(int argc, char **argv) {
             {"threads_num", required_argument, 0, 0},
             {"array_size", required_argument, 0, 1},
             {"seed", required_argument, 0, 2},
+            {"numa", no_argument, 0, 3},
+            {"work_stealing", no_argument, 0, 4},
+            {"grain", required_argument, 0, 5},
+            {"trace", required_argument, 0, 6},
             {0, 0, 0, 0}
         };
         
@@ -51,18 +268,74 @@ int main(int argc, char **argv) {
                     return 1;
                 }
                 break;
+            case 3:
+                numa = true;
+                break;
+            case 4:
+                work_stealing = true;
+                break;
+            case 5:
+                grain = atoi(optarg);
+                if (grain <= 0) {
+                    fprintf(stderr, "grain must be positive\n");
+                    return 1;
+                }
+                break;
+            case 6:
+                trace_path = optarg;
+                break;
             default:
-                fprintf(stderr, "Usage: %s --threads_num \"num\" --seed \"num\" --array_size \"num\"\n", argv[0]);
+                fprintf(stderr, "Usage: %s --threads_num \"num\" --seed \"num\" --array_size \"num\" [--numa | --work_stealing [--grain \"num\"]] [--trace \"file\"]\n", argv[0]);
                 return 1;
         }
     }
     
     // Проверка наличия всех параметров
     if (threads_num == 0 || array_size == 0 || seed == 0) {
-        fprintf(stderr, "Usage: %s --threads_num \"num\" --seed \"num\" --array_size \"num\"\n", argv[0]);
+        fprintf(stderr, "Usage: %s --threads_num \"num\" --seed \"num\" --array_size \"num\" [--numa | --work_stealing [--grain \"num\"]] [--trace \"file\"]\n", argv[0]);
         return 1;
     }
+
+    TraceInit(trace_path);
+    TraceSetThreadName("main");
     
+    if (numa) {
+        // Страницы не трогаем: их разместят потоки на своих узлах
+        size_t array_bytes = sizeof(int) * array_size;
+        int *array = mmap(NULL, array_bytes, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (array == MAP_FAILED) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 1;
+        }
+
+        int64_t total_sum = 0;
+        double elapsed_time = 0;
+        if (RunNumaSum(array, array_size, threads_num, seed, &total_sum,
+                       &elapsed_time) != 0) {
+            munmap(array, array_bytes);
+            return 1;
+        }
+
+        int64_t sequential_sum = 0;
+        for (uint32_t i = 0; i < array_size; i++) {
+            sequential_sum += array[i];
+        }
+
+        printf("\n=== Parallel Sum Results (NUMA) ===\n");
+        printf("Array size: %u\n", array_size);
+        printf("Threads: %u\n", threads_num);
+        printf("Seed: %u\n", seed);
+        printf("Parallel sum: %" PRId64 "\n", total_sum);
+        printf("Sequential sum: %" PRId64 "\n", sequential_sum);
+        printf("Elapsed time: %.2f ms\n", elapsed_time);
+        printf(total_sum == sequential_sum ? "✓ Results match!\n"
+                                           : "✗ Results DO NOT match!\n");
+
+        munmap(array, array_bytes);
+        return 0;
+    }
+
     // Выделение памяти для массива
     int *array = malloc(sizeof(int) * array_size);
     if (array == NULL) {
@@ -71,56 +344,22 @@ int main(int argc, char **argv) {
     }
     
     // Генерация массива
+    struct TraceSpan generate = TraceBegin("generate");
     GenerateArray(array, array_size, seed);
+    TraceEnd(generate);
     
-    // Подготовка аргументов для потоков
-    struct SumArgs args[threads_num];
-    pthread_t threads[threads_num];
-    
-    // Разделение массива между потоками
-    int chunk_size = array_size / threads_num;
-    for (uint32_t i = 0; i < threads_num; i++) {
-        args[i].array = array;
-        args[i].begin = i * chunk_size;
-        args[i].end = (i == threads_num - 1) ? array_size : (i + 1) * chunk_size;
-    }
-    
-    // Начало отсчета времени
-    struct timeval start_time;
-    gettimeofday(&start_time, NULL);
-    
-    // Создание потоков
-    for (uint32_t i = 0; i < threads_num; i++) {
-        if (pthread_create(&threads[i], NULL, ThreadSum, (void *)&args[i]) != 0) {
-            fprintf(stderr, "Error: pthread_create failed!\n");
-            free(array);
-            return 1;
-        }
-    }
-    
-    // Ожидание завершения потоков и сбор результатов
-    int total_sum = 0;
-    for (uint32_t i = 0; i < threads_num; i++) {
-        int *thread_sum = NULL;
-        if (pthread_join(threads[i], (void **)&thread_sum) != 0) {
-            fprintf(stderr, "Error: pthread_join failed!\n");
-            free(array);
-            return 1;
-        }
-        total_sum += *thread_sum;
-        free(thread_sum);
+    int64_t total_sum = 0;
+    double elapsed_time = 0;
+    int err = work_stealing
+                  ? RunStealSum(array, array_size, threads_num, grain, &total_sum, &elapsed_time)
+                  : RunStaticSum(array, array_size, threads_num, &total_sum, &elapsed_time);
+    if (err != 0) {
+        free(array);
+        return 1;
     }
     
-    // Конец отсчета времени
-    struct timeval finish_time;
-    gettimeofday(&finish_time, NULL);
-    
-    // Вычисление времени выполнения
-    double elapsed_time = (finish_time.tv_sec - start_time.tv_sec) * 1000.0;
-    elapsed_time += (finish_time.tv_usec - start_time.tv_usec) / 1000.0;
-    
     // Проверка результата (последовательный подсчет для верификации)
-    int sequential_sum = 0;
+    int64_t sequential_sum = 0;
     for (uint32_t i = 0; i < array_size; i++) {
         sequential_sum += array[i];
     }
@@ -130,8 +369,9 @@ int main(int argc, char **argv) {
     printf("Array size: %u\n", array_size);
     printf("Threads: %u\n", threads_num);
     printf("Seed: %u\n", seed);
-    printf("Parallel sum: %d\n", total_sum);
-    printf("Sequential sum: %d\n", sequential_sum);
+    printf("Parallel sum: %" PRId64 "\n", total_sum);
+    printf("Sequential sum: %" PRId64 "\n", sequential_sum);
+    printf("Sum kernel: %s\n", SumKernelName());
     printf("Elapsed time: %.2f ms\n", elapsed_time);
     
     if (total_sum == sequential_sum) {
@@ -2,18 +2,147 @@
 #include <pthread.h>
 #include "sum.h"
 
-int Sum(const struct SumArgs *args) {
-    int sum = 0;
+#ifdef SUM_X86
+#include <immintrin.h>
+#endif
+
+_Static_assert(sizeof(void *) >= sizeof(int64_t),
+               "ThreadSum returns int64_t through void *");
+
+typedef int64_t (*SumFunc)(const struct SumArgs *args);
+typedef __int128 (*Sum128Func)(const struct SumArgs64 *args);
+
+static SumFunc sum_impl = SumScalar;
+static Sum128Func sum128_impl = Sum128Scalar;
+static const char *sum_name = "scalar";
+
+int64_t SumScalar(const struct SumArgs *args) {
+    int64_t sum = 0;
     for (int i = args->begin; i < args->end; i++) {
         sum += args->array[i];
     }
     return sum;
 }
 
+__int128 Sum128Scalar(const struct SumArgs64 *args) {
+    __int128 sum = 0;
+    for (size_t i = args->begin; i < args->end; i++) {
+        sum += args->array[i];
+    }
+    return sum;
+}
+
+#ifdef SUM_X86
+
+// Четыре независимых аккумулятора по 4 x int64: сложения разных
+// аккумуляторов не ждут друг друга, задержка vpaddq скрывается.
+__attribute__((target("avx2")))
+int64_t SumAVX2(const struct SumArgs *args) {
+    const int *array = args->array;
+    int i = args->begin;
+    int end = args->end;
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    __m256i acc2 = _mm256_setzero_si256();
+    __m256i acc3 = _mm256_setzero_si256();
+
+    for (; end - i >= 16; i += 16) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(array + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(array + i + 4));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(array + i + 8));
+        __m128i v3 = _mm_loadu_si128((const __m128i *)(array + i + 12));
+        acc0 = _mm256_add_epi64(acc0, _mm256_cvtepi32_epi64(v0));
+        acc1 = _mm256_add_epi64(acc1, _mm256_cvtepi32_epi64(v1));
+        acc2 = _mm256_add_epi64(acc2, _mm256_cvtepi32_epi64(v2));
+        acc3 = _mm256_add_epi64(acc3, _mm256_cvtepi32_epi64(v3));
+    }
+
+    acc0 = _mm256_add_epi64(_mm256_add_epi64(acc0, acc1),
+                            _mm256_add_epi64(acc2, acc3));
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, acc0);
+    int64_t sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    for (; i < end; i++) {
+        sum += array[i];
+    }
+    return sum;
+}
+
+// int64 раскладывается на знаковую старшую и беззнаковую младшую половины
+// по 32 бита; каждая копится в своих 64-битных ячейках. Блок ограничен,
+// чтобы младшие суммы (< 2^32 каждая) не переполнили 64 бита.
+// Переопределяется при сборке: проверка с маленьким блоком (make
+// test_sum128) проходит через сброс ячеек много раз.
+#ifndef SUM128_BLOCK
+#define SUM128_BLOCK (1u << 28)
+#endif
+
+// Арифметический сдвиг int64 вправо на 32 (в AVX2 нет vpsraq):
+// старшее слово переносится вниз, наверх пишется его знак
+__attribute__((target("avx2")))
+static inline __m256i HighHalf(__m256i v) {
+    __m256i high = _mm256_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 1, 1));
+    return _mm256_blend_epi32(high, _mm256_srai_epi32(high, 31), 0xAA);
+}
+
+__attribute__((target("avx2")))
+__int128 Sum128AVX2(const struct SumArgs64 *args) {
+    const int64_t *array = args->array;
+    size_t i = args->begin;
+    size_t end = args->end;
+    const __m256i low_mask = _mm256_set1_epi64x(0xFFFFFFFFLL);
+    __int128 sum = 0;
+
+    while (end - i >= 8) {
+        size_t block_end = (end - i > SUM128_BLOCK) ? i + SUM128_BLOCK : end;
+        __m256i lo0 = _mm256_setzero_si256(), lo1 = _mm256_setzero_si256();
+        __m256i hi0 = _mm256_setzero_si256(), hi1 = _mm256_setzero_si256();
+
+        for (; block_end - i >= 8; i += 8) {
+            __m256i v0 = _mm256_loadu_si256((const __m256i *)(array + i));
+            __m256i v1 = _mm256_loadu_si256((const __m256i *)(array + i + 4));
+            lo0 = _mm256_add_epi64(lo0, _mm256_and_si256(v0, low_mask));
+            lo1 = _mm256_add_epi64(lo1, _mm256_and_si256(v1, low_mask));
+            hi0 = _mm256_add_epi64(hi0, HighHalf(v0));
+            hi1 = _mm256_add_epi64(hi1, HighHalf(v1));
+        }
+
+        uint64_t lo_lanes[4];
+        int64_t hi_lanes[4];
+        _mm256_storeu_si256((__m256i *)lo_lanes, _mm256_add_epi64(lo0, lo1));
+        _mm256_storeu_si256((__m256i *)hi_lanes, _mm256_add_epi64(hi0, hi1));
+        for (int lane = 0; lane < 4; lane++) {
+            sum += (__int128)lo_lanes[lane];
+            sum += (__int128)hi_lanes[lane] * ((__int128)1 << 32);
+        }
+    }
+
+    for (; i < end; i++) {
+        sum += array[i];
+    }
+    return sum;
+}
+
+// Выбор реализации один раз при загрузке программы (до main)
+__attribute__((constructor)) static void SelectSum(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        sum_impl = SumAVX2;
+        sum128_impl = Sum128AVX2;
+        sum_name = "avx2";
+    }
+}
+
+#endif
+
+int64_t Sum(const struct SumArgs *args) { return sum_impl(args); }
+
+__int128 Sum128(const struct SumArgs64 *args) { return sum128_impl(args); }
+
+const char *SumKernelName(void) { return sum_name; }
+
 void *ThreadSum(void *args) {
     struct SumArgs *sum_args = (struct SumArgs *)args;
-    int *result = malloc(sizeof(int));
-    if (result == NULL) return NULL;
-    *result = Sum(sum_args);
-    return (void *)result;
+    return (void *)(intptr_t)Sum(sum_args);
 }
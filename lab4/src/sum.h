@@ -1,13 +1,47 @@
 #ifndef SUM_H
 #define SUM_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SUM_X86 1
+#endif
+
 struct SumArgs {
     int *array;
     int begin;
     int end;
 };
 
-int Sum(const struct SumArgs *args);
+// Аргументы для массива int64_t (сумма может не влезть в 64 бита)
+struct SumArgs64 {
+    int64_t *array;
+    size_t begin;
+    size_t end;
+};
+
+// Сумма int на [begin, end) в 64-битном аккумуляторе: переполнение
+// невозможно, пока элементов меньше 2^32.
+// Реализация (scalar/AVX2) выбирается один раз при старте по CPUID.
+int64_t Sum(const struct SumArgs *args);
+
+// Сумма int64_t на [begin, end) в 128-битном аккумуляторе
+__int128 Sum128(const struct SumArgs64 *args);
+
+// Поток: частичная сумма возвращается по значению прямо в void *
+// (без malloc), забирать через (int64_t)(intptr_t) после pthread_join
 void *ThreadSum(void *args);
 
+// Имя выбранной реализации ("scalar", "avx2")
+const char *SumKernelName(void);
+
+// Отдельные реализации, доступны для тестов и замеров
+int64_t SumScalar(const struct SumArgs *args);
+__int128 Sum128Scalar(const struct SumArgs64 *args);
+#ifdef SUM_X86
+int64_t SumAVX2(const struct SumArgs *args);
+__int128 Sum128AVX2(const struct SumArgs64 *args);
+#endif
+
 #endif
@@ -0,0 +1,153 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sum.h"
+#include "utils.h"
+
+// Замер пропускной способности Sum: GB/s для разного числа потоков и
+// реализаций, затем однопоточный Sum128 с проверкой против скалярной
+// версии. Запуск: ./sum_bench [array_size] [max_threads] [repeats]
+
+// Массив int64 для Sum128 не больше 128 MB
+#define SUM128_MAX_SIZE (1 << 24)
+
+typedef int64_t (*SumFunc)(const struct SumArgs *args);
+
+struct BenchArgs {
+    struct SumArgs sum;
+    SumFunc func;
+    int repeats;
+    int64_t result;
+};
+
+static void *ThreadBench(void *args) {
+    struct BenchArgs *bench = (struct BenchArgs *)args;
+    for (int r = 0; r < bench->repeats; r++) {
+        bench->result = bench->func(&bench->sum);
+    }
+    return NULL;
+}
+
+static double NowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void RunBench(const char *name, SumFunc func, int *array, int array_size,
+                     int threads_num, int repeats) {
+    pthread_t threads[threads_num];
+    struct BenchArgs args[threads_num];
+    int chunk_size = array_size / threads_num;
+
+    for (int i = 0; i < threads_num; i++) {
+        args[i].sum.array = array;
+        args[i].sum.begin = i * chunk_size;
+        args[i].sum.end = (i == threads_num - 1) ? array_size : (i + 1) * chunk_size;
+        args[i].func = func;
+        args[i].repeats = repeats;
+    }
+
+    double start = NowMs();
+    for (int i = 0; i < threads_num; i++) {
+        pthread_create(&threads[i], NULL, ThreadBench, &args[i]);
+    }
+    int64_t total = 0;
+    for (int i = 0; i < threads_num; i++) {
+        pthread_join(threads[i], NULL);
+        total += args[i].result;
+    }
+    double elapsed = NowMs() - start;
+
+    double bytes = (double)array_size * sizeof(int) * repeats;
+    printf("%-8s threads=%-3d %8.2f ms  %6.2f GB/s  sum=%" PRId64 "\n", name,
+           threads_num, elapsed, bytes / (elapsed * 1e6), total);
+}
+
+typedef __int128 (*Sum128Func)(const struct SumArgs64 *args);
+
+static void RunBench128(const char *name, Sum128Func func, int64_t *array,
+                        size_t array_size, int repeats, __int128 *result) {
+    struct SumArgs64 args = {array, 0, array_size};
+    double start = NowMs();
+    for (int r = 0; r < repeats; r++) {
+        *result = func(&args);
+    }
+    double elapsed = NowMs() - start;
+    double bytes = (double)array_size * sizeof(int64_t) * repeats;
+    printf("%-8s threads=1   %8.2f ms  %6.2f GB/s\n", name, elapsed,
+           bytes / (elapsed * 1e6));
+}
+
+// Sum128 на значениях во весь диапазон int64 обоих знаков: сумма выходит
+// за 64 бита, и ошибка в старших половинах AVX2-версии сразу видна.
+// Возвращает false, если реализации разошлись.
+static bool BenchSum128(const int *source, int source_size, int repeats) {
+    size_t array_size = source_size < SUM128_MAX_SIZE ? (size_t)source_size
+                                                      : SUM128_MAX_SIZE;
+    int64_t *array = malloc(sizeof(int64_t) * array_size);
+    if (array == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return false;
+    }
+    for (size_t i = 0; i < array_size; i++) {
+        array[i] = (int64_t)((uint64_t)source[i] * 0x9E3779B97F4A7C15ull);
+    }
+
+    printf("Sum128: %zu int64 (%.1f MB)\n", array_size,
+           array_size * sizeof(int64_t) / 1e6);
+    __int128 expected = 0;
+    RunBench128("scalar", Sum128Scalar, array, array_size, repeats, &expected);
+    bool ok = true;
+#ifdef SUM_X86
+    if (__builtin_cpu_supports("avx2")) {
+        __int128 sum = 0;
+        RunBench128("avx2", Sum128AVX2, array, array_size, repeats, &sum);
+        ok = sum == expected;
+        // Невыровненные границы: хвосты до и после векторного цикла
+        for (size_t shift = 1; ok && shift < 8 && shift < array_size; shift++) {
+            struct SumArgs64 args = {array, shift, array_size - shift / 2};
+            ok = Sum128AVX2(&args) == Sum128Scalar(&args);
+        }
+    }
+#endif
+    printf(ok ? "Sum128: results match\n" : "Sum128: results DO NOT match\n");
+    free(array);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    int array_size = argc > 1 ? atoi(argv[1]) : 1 << 26;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+    int repeats = argc > 3 ? atoi(argv[3]) : 10;
+    if (array_size <= 0 || max_threads <= 0 || repeats <= 0) {
+        fprintf(stderr, "Usage: %s [array_size] [max_threads] [repeats]\n", argv[0]);
+        return 1;
+    }
+
+    int *array = malloc(sizeof(int) * array_size);
+    if (array == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    GenerateArray(array, array_size, 42);
+
+    printf("Array: %d ints (%.1f MB), %d repeats, dispatched kernel: %s\n",
+           array_size, array_size * sizeof(int) / 1e6, repeats, SumKernelName());
+    for (int threads_num = 1; threads_num <= max_threads; threads_num *= 2) {
+        RunBench("scalar", SumScalar, array, array_size, threads_num, repeats);
+#ifdef SUM_X86
+        if (__builtin_cpu_supports("avx2")) {
+            RunBench("avx2", SumAVX2, array, array_size, threads_num, repeats);
+        }
+#endif
+    }
+
+    bool ok = BenchSum128(array, array_size, repeats);
+    free(array);
+    return ok ? 0 : 1;
+}
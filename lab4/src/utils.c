@@ -1,10 +1,184 @@
 #include "utils.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
-void GenerateArray(int *array, unsigned int array_size, unsigned int seed) {
-  srand(seed);
-  for (int i = 0; i < array_size; i++) {
-    array[i] = rand();
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UTILS_X86 1
+#endif
+
+#define SPLITMIX_GAMMA 0x9E3779B97F4A7C15ULL
+#define SPLITMIX_MUL1 0xBF58476D1CE4E5B9ULL
+#define SPLITMIX_MUL2 0x94D049BB133111EBULL
+
+// Меньше этого размера потоки не создаются
+#define GENERATE_PARALLEL_MIN (1u << 20)
+
+static inline uint64_t SplitMix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * SPLITMIX_MUL1;
+  z = (z ^ (z >> 27)) * SPLITMIX_MUL2;
+  return z ^ (z >> 31);
+}
+
+// Ключ потока: перемешанный seed, чтобы близкие seed давали разные массивы
+static inline uint64_t GenerateKey(uint64_t seed) { return SplitMix64(seed); }
+
+// Случайное 64-битное число для элемента с номером index
+static inline uint64_t GenerateAt(uint64_t key, size_t index) {
+  return SplitMix64(key + (index + 1) * SPLITMIX_GAMMA);
+}
+
+static void FillRangeScalar(void *array, size_t begin, size_t end,
+                            uint64_t key, enum ArrayElementType type) {
+  for (size_t i = begin; i < end; i++) {
+    uint64_t value = GenerateAt(key, i);
+    switch (type) {
+      case ARRAY_INT32:
+        ((int *)array)[i] = (int)(value >> 33);
+        break;
+      case ARRAY_INT64:
+        ((int64_t *)array)[i] = (int64_t)value;
+        break;
+      case ARRAY_FLOAT:
+        ((float *)array)[i] = (float)(value >> 40) * (1.0f / 16777216.0f);
+        break;
+    }
+  }
+}
+
+#ifdef UTILS_X86
+// 64-битное умножение по модулю 2^64 на AVX2 (vpmuludq дает только
+// 32x32->64, поэтому собираем из трех произведений).
+__attribute__((target("avx2")))
+static inline __m256i Mul64(__m256i a, __m256i b) {
+  __m256i lo = _mm256_mul_epu32(a, b);
+  __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                   _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+  return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i SplitMix64x4(__m256i z) {
+  z = Mul64(_mm256_xor_si256(z, _mm256_srli_epi64(z, 30)),
+            _mm256_set1_epi64x((long long)SPLITMIX_MUL1));
+  z = Mul64(_mm256_xor_si256(z, _mm256_srli_epi64(z, 27)),
+            _mm256_set1_epi64x((long long)SPLITMIX_MUL2));
+  return _mm256_xor_si256(z, _mm256_srli_epi64(z, 31));
+}
+
+// Векторное заполнение по 4 элемента; дает те же значения, что и скалярное
+__attribute__((target("avx2")))
+static void FillRangeAVX2(void *array, size_t begin, size_t end, uint64_t key,
+                          enum ArrayElementType type) {
+  size_t i = begin;
+  __m256i counter = _mm256_set_epi64x(
+      (long long)(key + (i + 4) * SPLITMIX_GAMMA),
+      (long long)(key + (i + 3) * SPLITMIX_GAMMA),
+      (long long)(key + (i + 2) * SPLITMIX_GAMMA),
+      (long long)(key + (i + 1) * SPLITMIX_GAMMA));
+  const __m256i step = _mm256_set1_epi64x((long long)(4 * SPLITMIX_GAMMA));
+  // Индексы младших 32 бит каждой 64-битной ячейки
+  const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+  for (; end - i >= 4; i += 4) {
+    __m256i value = SplitMix64x4(counter);
+    counter = _mm256_add_epi64(counter, step);
+    switch (type) {
+      case ARRAY_INT32: {
+        __m256i packed =
+            _mm256_permutevar8x32_epi32(_mm256_srli_epi64(value, 33), pack);
+        _mm_storeu_si128((__m128i *)((int *)array + i),
+                         _mm256_castsi256_si128(packed));
+        break;
+      }
+      case ARRAY_INT64:
+        _mm256_storeu_si256((__m256i *)((int64_t *)array + i), value);
+        break;
+      case ARRAY_FLOAT: {
+        __m256i packed =
+            _mm256_permutevar8x32_epi32(_mm256_srli_epi64(value, 40), pack);
+        __m128 f = _mm_cvtepi32_ps(_mm256_castsi256_si128(packed));
+        _mm_storeu_ps((float *)array + i,
+                      _mm_mul_ps(f, _mm_set1_ps(1.0f / 16777216.0f)));
+        break;
+      }
+    }
+  }
+
+  FillRangeScalar(array, i, end, key, type);
+}
+#endif
+
+static void FillRange(void *array, size_t begin, size_t end, uint64_t key,
+                      enum ArrayElementType type) {
+#ifdef UTILS_X86
+  if (__builtin_cpu_supports("avx2")) {
+    FillRangeAVX2(array, begin, end, key, type);
+    return;
+  }
+#endif
+  FillRangeScalar(array, begin, end, key, type);
+}
+
+struct GenerateArgs {
+  void *array;
+  size_t begin;
+  size_t end;
+  uint64_t key;
+  enum ArrayElementType type;
+};
+
+static void *ThreadGenerate(void *args) {
+  struct GenerateArgs *gen = (struct GenerateArgs *)args;
+  FillRange(gen->array, gen->begin, gen->end, gen->key, gen->type);
+  return NULL;
+}
+
+void GenerateArrayTyped(void *array, size_t array_size, uint64_t seed,
+                        enum ArrayElementType type, int threads_num) {
+  uint64_t key = GenerateKey(seed);
+
+  if (threads_num <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads_num = cpus > 0 ? (int)cpus : 1;
+  }
+  if (array_size < GENERATE_PARALLEL_MIN || threads_num == 1) {
+    FillRange(array, 0, array_size, key, type);
+    return;
   }
+
+  pthread_t threads[threads_num];
+  struct GenerateArgs args[threads_num];
+  size_t chunk_size = array_size / threads_num;
+  int started = 0;
+
+  for (int i = 0; i < threads_num; i++) {
+    args[i].array = array;
+    args[i].begin = i * chunk_size;
+    args[i].end = (i == threads_num - 1) ? array_size : (i + 1) * chunk_size;
+    args[i].key = key;
+    args[i].type = type;
+    if (pthread_create(&threads[i], NULL, ThreadGenerate, &args[i]) != 0) {
+      // Не удалось создать поток: заполняем его часть сами
+      FillRange(array, args[i].begin, args[i].end, key, type);
+      continue;
+    }
+    threads[started++] = threads[i];
+  }
+
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+void GenerateArrayRange(int *array, size_t begin, size_t end,
+                        unsigned int seed) {
+  FillRange(array, begin, end, GenerateKey(seed), ARRAY_INT32);
+}
+
+void GenerateArray(int *array, unsigned int array_size, unsigned int seed) {
+  GenerateArrayTyped(array, array_size, seed, ARRAY_INT32, 0);
 }
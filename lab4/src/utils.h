@@ -1,11 +1,35 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 struct MinMax {
   int min;
   int max;
 };
 
+// Тип элементов для GenerateArrayTyped
+enum ArrayElementType {
+  ARRAY_INT32,  // int, значения в [0, INT_MAX] как у rand()
+  ARRAY_INT64,  // int64_t, все 64 бита случайные
+  ARRAY_FLOAT   // float в [0, 1)
+};
+
+// Заполняет массив псевдослучайными числами. Генератор счетный
+// (SplitMix64 от номера элемента), поэтому результат зависит только от
+// seed и не зависит от числа потоков, которые заполняют массив.
 void GenerateArray(int *array, unsigned int array_size, unsigned int seed);
 
+// Заполняет только [begin, end) теми же значениями, что дал бы GenerateArray
+// для всего массива. Удобно, когда каждый поток сам заполняет свою часть
+// (например, чтобы страницы легли на его узел NUMA).
+void GenerateArrayRange(int *array, size_t begin, size_t end,
+                        unsigned int seed);
+
+// То же для произвольного типа элементов. threads_num <= 0 - по числу
+// процессоров.
+void GenerateArrayTyped(void *array, size_t array_size, uint64_t seed,
+                        enum ArrayElementType type, int threads_num);
+
 #endif
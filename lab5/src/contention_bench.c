@@ -0,0 +1,344 @@
+/*
+ * contention_bench.c
+ *
+ * The shared counter of mutex.c under real contention: N threads do
+ * "read common, spin for a while, write it back" for a fixed time, each
+ * variant protecting it differently. Reports ops/sec and how evenly the
+ * operations were spread over the threads.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "locks.h"
+#include "sharded_counter.h"
+
+#define MAX_THREADS 256
+
+enum Variant {
+  VARIANT_MUTEX,
+  VARIANT_SPIN,
+  VARIANT_TICKET,
+  VARIANT_MCS,
+  VARIANT_ATOMIC,
+  VARIANT_SHARDED,
+  VARIANT_PERCPU,
+  VARIANT_PACKED,
+  VARIANTS_NUM
+};
+
+static const char *variant_names[VARIANTS_NUM] = {
+    "mutex", "spin", "ticket", "mcs", "atomic", "sharded", "percpu", "packed"};
+
+// Everything the threads share sits on its own cache line, so the numbers
+// measure the primitive and not false sharing with a neighbour.
+struct Shared {
+  pthread_mutex_t mutex __attribute__((aligned(CACHE_LINE)));
+  struct SpinLock spin;
+  struct TicketLock ticket;
+  struct McsLock mcs;
+  long common __attribute__((aligned(CACHE_LINE)));
+  atomic_long atomic_common __attribute__((aligned(CACHE_LINE)));
+  struct ShardedCounter *sharded;
+  struct PerCpuCounter *percpu;
+  // Per-thread counters laid out like r1, r2, r3 in mutex.c: adjacent,
+  // so up to eight threads write to the same cache line
+  atomic_long packed[MAX_THREADS] __attribute__((aligned(CACHE_LINE)));
+  atomic_bool stop __attribute__((aligned(CACHE_LINE)));
+  pthread_barrier_t start;
+  enum Variant variant;
+  unsigned long cs_len;
+};
+
+struct ThreadArgs {
+  struct Shared *shared;
+  struct McsNode node;
+  int index;
+  long ops;
+} __attribute__((aligned(CACHE_LINE)));
+
+// The "long cycle" of mutex.c, kept from being optimized away
+static inline void CriticalWork(unsigned long len) {
+  for (unsigned long k = 0; k < len; k++)
+    __asm__ volatile("" ::: "memory");
+}
+
+static inline void Increment(struct Shared *shared) {
+  long work = shared->common;
+  work++;
+  CriticalWork(shared->cs_len);
+  shared->common = work;
+}
+
+static void *BenchThread(void *arg) {
+  struct ThreadArgs *args = (struct ThreadArgs *)arg;
+  struct Shared *shared = args->shared;
+  long ops = 0;
+  struct CounterSlot *slot = NULL;
+  if (shared->variant == VARIANT_SHARDED &&
+      (slot = ShardedCounterRegister(shared->sharded)) == NULL) {
+    fprintf(stderr, "No free counter slot\n");
+    exit(1);
+  }
+  atomic_long *packed = &shared->packed[args->index];
+
+  pthread_barrier_wait(&shared->start);
+  while (!atomic_load_explicit(&shared->stop, memory_order_relaxed)) {
+    switch (shared->variant) {
+    case VARIANT_MUTEX:
+      pthread_mutex_lock(&shared->mutex);
+      Increment(shared);
+      pthread_mutex_unlock(&shared->mutex);
+      break;
+    case VARIANT_SPIN:
+      SpinLockAcquire(&shared->spin);
+      Increment(shared);
+      SpinLockRelease(&shared->spin);
+      break;
+    case VARIANT_TICKET:
+      TicketLockAcquire(&shared->ticket);
+      Increment(shared);
+      TicketLockRelease(&shared->ticket);
+      break;
+    case VARIANT_MCS:
+      McsLockAcquire(&shared->mcs, &args->node);
+      Increment(shared);
+      McsLockRelease(&shared->mcs, &args->node);
+      break;
+    case VARIANT_ATOMIC:
+      // The update itself is atomic, the work needs no lock around it
+      atomic_fetch_add_explicit(&shared->atomic_common, 1,
+                                memory_order_relaxed);
+      CriticalWork(shared->cs_len);
+      break;
+    case VARIANT_SHARDED:
+      CounterSlotAdd(slot, 1);
+      CriticalWork(shared->cs_len);
+      break;
+    case VARIANT_PERCPU:
+      PerCpuCounterAdd(shared->percpu, 1);
+      CriticalWork(shared->cs_len);
+      break;
+    case VARIANT_PACKED:
+      atomic_store_explicit(
+          packed, atomic_load_explicit(packed, memory_order_relaxed) + 1,
+          memory_order_relaxed);
+      CriticalWork(shared->cs_len);
+      break;
+    default:
+      break;
+    }
+    ops++;
+  }
+  args->ops = ops;
+  return NULL;
+}
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs one variant with threads_num threads for duration_ms and prints a
+// table row. Returns false if the final counter disagrees with the number
+// of operations the threads performed.
+static bool RunVariant(enum Variant variant, int threads_num,
+                       unsigned long cs_len, int duration_ms) {
+  struct Shared *shared = aligned_alloc(CACHE_LINE, sizeof(struct Shared));
+  struct ThreadArgs *args =
+      aligned_alloc(CACHE_LINE, threads_num * sizeof(struct ThreadArgs));
+  pthread_t *threads = calloc(threads_num, sizeof(pthread_t));
+  if (shared == NULL || args == NULL || threads == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  memset(shared, 0, sizeof(*shared));
+  memset(args, 0, threads_num * sizeof(struct ThreadArgs));
+  pthread_mutex_init(&shared->mutex, NULL);
+  pthread_barrier_init(&shared->start, NULL, threads_num + 1);
+  shared->variant = variant;
+  shared->cs_len = cs_len;
+  shared->sharded = ShardedCounterCreate(threads_num);
+  shared->percpu = PerCpuCounterCreate();
+  if (shared->sharded == NULL || shared->percpu == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  for (int i = 0; i < threads_num; i++) {
+    args[i].shared = shared;
+    args[i].index = i;
+    if (pthread_create(&threads[i], NULL, BenchThread, &args[i]) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+
+  pthread_barrier_wait(&shared->start);
+  double started = NowSeconds();
+  struct timespec pause = {duration_ms / 1000,
+                           (long)(duration_ms % 1000) * 1000000};
+  while (nanosleep(&pause, &pause) != 0 && errno == EINTR)
+    ;
+  atomic_store(&shared->stop, true);
+
+  long total = 0, min_ops = -1, max_ops = 0;
+  double sum_squares = 0;
+  long counter = 0;
+  for (int i = 0; i < threads_num; i++) {
+    if (pthread_join(threads[i], NULL) != 0) {
+      perror("pthread_join");
+      exit(1);
+    }
+  }
+  double elapsed = NowSeconds() - started;
+  for (int i = 0; i < threads_num; i++) {
+    long ops = args[i].ops;
+    total += ops;
+    sum_squares += (double)ops * ops;
+    if (min_ops < 0 || ops < min_ops)
+      min_ops = ops;
+    if (ops > max_ops)
+      max_ops = ops;
+  }
+  switch (variant) {
+  case VARIANT_ATOMIC:
+    counter = atomic_load(&shared->atomic_common);
+    break;
+  case VARIANT_SHARDED:
+    counter = ShardedCounterRead(shared->sharded);
+    break;
+  case VARIANT_PERCPU:
+    counter = PerCpuCounterRead(shared->percpu);
+    break;
+  case VARIANT_PACKED:
+    for (int i = 0; i < threads_num; i++)
+      counter += atomic_load(&shared->packed[i]);
+    break;
+  default:
+    counter = shared->common;
+  }
+
+  // Jain's index: 1.0 when every thread did the same number of
+  // operations, 1/threads when one thread did all of them
+  double jain = sum_squares > 0 ? (double)total * total /
+                                      (threads_num * sum_squares)
+                                : 0;
+  printf("%7d  %-8s %10.3f %8.3f %8.3f%s\n", threads_num,
+         variant_names[variant], total / elapsed / 1e6, jain,
+         max_ops ? (double)min_ops / max_ops : 0.0,
+         counter == total ? "" : "  COUNTER MISMATCH");
+
+  ShardedCounterDestroy(shared->sharded);
+  PerCpuCounterDestroy(shared->percpu);
+  pthread_barrier_destroy(&shared->start);
+  pthread_mutex_destroy(&shared->mutex);
+  free(threads);
+  free(args);
+  free(shared);
+  return counter == total;
+}
+
+// Parses "1,2,4" into threads[]; returns the count or -1 on bad input
+static int ParseThreadList(const char *text, int *threads, int max) {
+  int count = 0;
+  char *copy = strdup(text);
+  char *save = NULL;
+  for (char *tok = strtok_r(copy, ",", &save); tok != NULL;
+       tok = strtok_r(NULL, ",", &save)) {
+    int n = atoi(tok);
+    if (n <= 0 || n > MAX_THREADS || count == max) {
+      free(copy);
+      return -1;
+    }
+    threads[count++] = n;
+  }
+  free(copy);
+  return count;
+}
+
+int main(int argc, char **argv) {
+  int thread_counts[32];
+  int counts_num = 0;
+  unsigned long cs_len = 100;
+  int duration_ms = 500;
+  bool enabled[VARIANTS_NUM];
+  for (int v = 0; v < VARIANTS_NUM; v++)
+    enabled[v] = true;
+
+  while (true) {
+    static struct option options[] = {{"threads", required_argument, 0, 0},
+                                      {"cs", required_argument, 0, 0},
+                                      {"duration", required_argument, 0, 0},
+                                      {"variant", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 0:
+      switch (option_index) {
+      case 0:
+        counts_num = ParseThreadList(optarg, thread_counts, 32);
+        break;
+      case 1:
+        cs_len = strtoul(optarg, NULL, 10);
+        break;
+      case 2:
+        duration_ms = atoi(optarg);
+        break;
+      case 3:
+        for (int v = 0; v < VARIANTS_NUM; v++)
+          enabled[v] = strstr(optarg, variant_names[v]) != NULL;
+        break;
+      }
+      break;
+
+    case '?':
+      printf("Arguments error\n");
+      break;
+    }
+  }
+
+  if (counts_num < 0 || duration_ms <= 0) {
+    fprintf(stderr,
+            "Using: %s [--threads 1,2,4,...] [--cs 100] [--duration 500] "
+            "[--variant mutex,spin,ticket,mcs,atomic,sharded,percpu,packed]\n",
+            argv[0]);
+    return 1;
+  }
+  if (counts_num == 0) {
+    // Powers of two up to twice the CPUs, to see oversubscription too
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int n = 1; n <= 2 * cpus && n <= MAX_THREADS && counts_num < 32;
+         n *= 2)
+      thread_counts[counts_num++] = n;
+    if (counts_num == 1 && thread_counts[0] < 2)
+      thread_counts[counts_num++] = 2;
+  }
+
+  printf("critical section: %lu iterations, %d ms per run\n", cs_len,
+         duration_ms);
+  printf("threads  variant       Mops/s     jain  min/max\n");
+  bool ok = true;
+  for (int i = 0; i < counts_num; i++) {
+    for (int v = 0; v < VARIANTS_NUM; v++) {
+      if (enabled[v])
+        ok &= RunVariant((enum Variant)v, thread_counts[i], cs_len,
+                         duration_ms);
+    }
+  }
+  return ok ? 0 : 1;
+}
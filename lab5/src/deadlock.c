@@ -0,0 +1,98 @@
+/*
+ * deadlock.c
+ *
+ * Two threads take the same two mutexes in opposite order (lab 5,
+ * task 3). Each grabs its first mutex, waits until the other has its
+ * own, and then blocks forever on the second one. --ordered makes both
+ * threads use the same order, which cannot deadlock. A watchdog reports
+ * the hang after --timeout seconds so the program always terminates.
+ *
+ * Under LD_PRELOAD=./liblockdep.so the inversion is reported before the
+ * second thread blocks.
+ */
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+pthread_mutex_t first = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t second = PTHREAD_MUTEX_INITIALIZER;
+pthread_barrier_t both_hold_one;
+atomic_int finished = 0;
+bool ordered = false;
+
+void *take_first_then_second(void *arg) {
+  pthread_mutex_lock(&first);
+  printf("thread 1: holds first, wants second\n");
+  pthread_barrier_wait(&both_hold_one);
+  pthread_mutex_lock(&second);
+  printf("thread 1: holds both\n");
+  pthread_mutex_unlock(&second);
+  pthread_mutex_unlock(&first);
+  finished++;
+  return NULL;
+}
+
+void *take_second_then_first(void *arg) {
+  if (ordered) {
+    // Wait for thread 1 to hold first, then queue up behind it
+    pthread_barrier_wait(&both_hold_one);
+    pthread_mutex_lock(&first);
+    pthread_mutex_lock(&second);
+  } else {
+    pthread_mutex_lock(&second);
+    printf("thread 2: holds second, wants first\n");
+    pthread_barrier_wait(&both_hold_one);
+    pthread_mutex_lock(&first);
+  }
+  printf("thread 2: holds both\n");
+  pthread_mutex_unlock(&first);
+  pthread_mutex_unlock(&second);
+  finished++;
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  int timeout = 3;
+  while (true) {
+    static struct option options[] = {{"ordered", no_argument, 0, 0},
+                                      {"timeout", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+    if (c == -1)
+      break;
+    if (c == 0 && option_index == 0)
+      ordered = true;
+    else if (c == 0 && option_index == 1)
+      timeout = atoi(optarg);
+    else {
+      printf("Using: %s [--ordered] [--timeout 3]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  pthread_t thread1, thread2;
+  pthread_barrier_init(&both_hold_one, NULL, 2);
+  if (pthread_create(&thread1, NULL, take_first_then_second, NULL) != 0 ||
+      pthread_create(&thread2, NULL, take_second_then_first, NULL) != 0) {
+    perror("pthread_create");
+    exit(1);
+  }
+
+  for (int i = 0; i < timeout * 10 && finished < 2; i++)
+    usleep(100000);
+  if (finished < 2) {
+    printf("deadlock: no thread finished in %d s\n", timeout);
+    // The threads can never be joined; exit takes them down
+    exit(1);
+  }
+  pthread_join(thread1, NULL);
+  pthread_join(thread2, NULL);
+  printf("All done, no deadlock\n");
+  return 0;
+}
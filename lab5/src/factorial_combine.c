@@ -0,0 +1,196 @@
+#include "factorial_combine.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "locks.h"
+#include "multmodulo.h"
+
+static const char *strategy_names[COMBINE_STRATEGIES_NUM] = {"mutex", "cas",
+                                                             "tree"};
+
+struct TreeSlot {
+  uint64_t product;
+  atomic_bool ready;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct CombineShared {
+  enum CombineStrategy strategy;
+  uint64_t mod;
+  int pnum;
+  pthread_mutex_t mutex;
+  uint64_t product;               // COMBINE_MUTEX
+  _Atomic uint64_t atomic_product; // COMBINE_CAS
+  struct TreeSlot *slots;          // COMBINE_TREE
+};
+
+struct CombineThread {
+  struct CombineShared *shared;
+  int index;
+  int ranges_num;
+  struct FactorialArgs ranges[2];
+  double compute_us;
+  double combine_us;
+};
+
+static double NowUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+const char *CombineStrategyName(enum CombineStrategy strategy) {
+  if (strategy < 0 || strategy >= COMBINE_STRATEGIES_NUM)
+    return "unknown";
+  return strategy_names[strategy];
+}
+
+static void CombineTree(struct CombineShared *shared, int index,
+                        uint64_t product) {
+  // At step s thread i (a multiple of 2s) absorbs the result of thread
+  // i + s; everyone else publishes its product and is done
+  for (int step = 1; step < shared->pnum; step *= 2) {
+    if (index % (2 * step) != 0)
+      break;
+    int partner = index + step;
+    if (partner >= shared->pnum)
+      continue;
+    unsigned spins = 0;
+    while (!atomic_load_explicit(&shared->slots[partner].ready,
+                                 memory_order_acquire))
+      SpinWait(&spins);
+    product = MultModulo(product, shared->slots[partner].product, shared->mod);
+  }
+  shared->slots[index].product = product;
+  atomic_store_explicit(&shared->slots[index].ready, true,
+                        memory_order_release);
+}
+
+static void *CombineThreadMain(void *arg) {
+  struct CombineThread *thread = (struct CombineThread *)arg;
+  struct CombineShared *shared = thread->shared;
+
+  double started = NowUs();
+  uint64_t product = 1 % shared->mod;
+  for (int r = 0; r < thread->ranges_num; r++)
+    product = MultModulo(product, Factorial(&thread->ranges[r]), shared->mod);
+  double computed = NowUs();
+
+  switch (shared->strategy) {
+  case COMBINE_MUTEX:
+    pthread_mutex_lock(&shared->mutex);
+    shared->product = MultModulo(shared->product, product, shared->mod);
+    pthread_mutex_unlock(&shared->mutex);
+    break;
+  case COMBINE_CAS: {
+    uint64_t old = atomic_load_explicit(&shared->atomic_product,
+                                        memory_order_relaxed);
+    // On failure old is reloaded and the product recomputed
+    while (!atomic_compare_exchange_weak_explicit(
+        &shared->atomic_product, &old, MultModulo(old, product, shared->mod),
+        memory_order_relaxed, memory_order_relaxed))
+      ;
+    break;
+  }
+  case COMBINE_TREE:
+    CombineTree(shared, thread->index, product);
+    break;
+  default:
+    break;
+  }
+
+  thread->compute_us = computed - started;
+  thread->combine_us = NowUs() - computed;
+  return NULL;
+}
+
+uint64_t ParallelFactorial(const struct FactorialArgs *args, int pnum,
+                           enum CombineStrategy strategy,
+                           struct CombineTiming *timing) {
+  double started = NowUs();
+  struct FactorialPlan plan;
+  PlanFactorial(args, &plan);
+  if (pnum <= 0)
+    pnum = 1;
+
+  struct CombineShared shared = {0};
+  shared.strategy = strategy;
+  shared.mod = plan.mod;
+  shared.pnum = pnum;
+  shared.product = 1 % plan.mod;
+  atomic_init(&shared.atomic_product, 1 % plan.mod);
+  pthread_mutex_init(&shared.mutex, NULL);
+
+  struct CombineThread *threads = calloc(pnum, sizeof(struct CombineThread));
+  pthread_t *tids = calloc(pnum, sizeof(pthread_t));
+  struct FactorialArgs *parts = calloc((size_t)pnum * 2, sizeof(*parts));
+  shared.slots = aligned_alloc(CACHE_LINE, pnum * sizeof(struct TreeSlot));
+  if (threads == NULL || tids == NULL || parts == NULL ||
+      shared.slots == NULL) {
+    free(threads);
+    free(tids);
+    free(parts);
+    free(shared.slots);
+    pthread_mutex_destroy(&shared.mutex);
+    // Fall back to the sequential engine rather than fail
+    return Factorial(args);
+  }
+  for (int i = 0; i < pnum; i++)
+    atomic_init(&shared.slots[i].ready, false);
+
+  // A zero plan has no ranges: every thread contributes 1
+  int ranges_num = plan.kind == FACTORIAL_ZERO ? 0 : plan.ranges_num;
+  for (int r = 0; r < ranges_num; r++)
+    SplitFactorialRange(plan.ranges[r].begin, plan.ranges[r].end, plan.mod,
+                        pnum, parts + r * pnum);
+
+  int created = 0;
+  for (int i = 0; i < pnum; i++) {
+    threads[i].shared = &shared;
+    threads[i].index = i;
+    threads[i].ranges_num = ranges_num;
+    for (int r = 0; r < ranges_num; r++)
+      threads[i].ranges[r] = parts[r * pnum + i];
+  }
+  for (; created < pnum; created++) {
+    if (pthread_create(&tids[created], NULL, CombineThreadMain,
+                       &threads[created]) != 0)
+      break;
+  }
+  // Threads that could not be started are run here; the tree waits for
+  // every index, so nobody may be skipped. An index only ever waits for
+  // higher ones, so they go from the top down.
+  for (int i = pnum - 1; i >= created; i--)
+    CombineThreadMain(&threads[i]);
+  for (int i = 0; i < created; i++)
+    pthread_join(tids[i], NULL);
+
+  uint64_t product = shared.product;
+  if (strategy == COMBINE_CAS)
+    product = atomic_load(&shared.atomic_product);
+  else if (strategy == COMBINE_TREE)
+    product = shared.slots[0].product;
+  uint64_t result = FinishFactorial(&plan, product);
+
+  if (timing != NULL) {
+    timing->compute_us = timing->combine_us = 0;
+    for (int i = 0; i < pnum; i++) {
+      if (threads[i].compute_us > timing->compute_us)
+        timing->compute_us = threads[i].compute_us;
+      if (threads[i].combine_us > timing->combine_us)
+        timing->combine_us = threads[i].combine_us;
+    }
+    timing->total_us = NowUs() - started;
+  }
+
+  pthread_mutex_destroy(&shared.mutex);
+  free(shared.slots);
+  free(parts);
+  free(tids);
+  free(threads);
+  return result;
+}
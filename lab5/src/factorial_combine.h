@@ -0,0 +1,33 @@
+#ifndef FACTORIAL_COMBINE_H
+#define FACTORIAL_COMBINE_H
+
+#include <stdint.h>
+
+#include "factorial.h"
+
+// How the per-thread partial products of ParallelFactorial are merged.
+enum CombineStrategy {
+  COMBINE_MUTEX, // every thread multiplies into a shared product under a mutex
+  COMBINE_CAS,   // the same shared product, updated with a CAS loop
+  COMBINE_TREE,  // pairwise reduction, thread i waits for thread i + step
+  COMBINE_STRATEGIES_NUM
+};
+
+const char *CombineStrategyName(enum CombineStrategy strategy);
+
+// Where the time of one ParallelFactorial call went, in microseconds
+struct CombineTiming {
+  double total_us;
+  double compute_us; // slowest thread's own range products
+  double combine_us; // slowest thread's time in the combine step; for the
+                     // tree this includes waiting for partners to finish
+};
+
+// k! style product over args (see PlanFactorial) computed by pnum threads;
+// the ranges of the plan are split evenly across them and the partial
+// products merged with strategy. timing may be NULL.
+uint64_t ParallelFactorial(const struct FactorialArgs *args, int pnum,
+                           enum CombineStrategy strategy,
+                           struct CombineTiming *timing);
+
+#endif
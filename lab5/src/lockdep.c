@@ -0,0 +1,524 @@
+/*
+ * lockdep.c
+ *
+ * LD_PRELOAD-able instrumentation of pthread mutexes:
+ *
+ *   LD_PRELOAD=./liblockdep.so ./program
+ *
+ * LOCKDEP_MODE selects what is recorded (default "order"):
+ *   order - every "lock B while holding A" adds the edge A -> B to a global
+ *           lock-order graph; an edge that closes a cycle is reported before
+ *           the thread blocks, with the stack of the current acquisition and
+ *           the stacks that established the opposite order.
+ *   stats - per-mutex wait and hold time histograms, printed at exit,
+ *           most contended mutexes first. Only clock reads and relaxed
+ *           atomics on the lock path.
+ *   all   - both.
+ * LOCKDEP_ABORT=1 aborts on the first cycle, LOCKDEP_TOP=N limits the
+ * stats report to N mutexes (default 10).
+ *
+ * Mutexes are identified by address. The tables are static so the hooks
+ * never allocate; when one fills up, further mutexes are not tracked.
+ * pthread_cond_wait releases and retakes the mutex inside glibc, so that
+ * time counts as hold time.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "locks.h"
+
+#define MAX_HELD 64
+#define MAX_FRAMES 12
+#define MAX_NODES 4096
+#define MAX_EDGES 8192
+#define MAX_STATS 4096
+#define HIST_BUCKETS 32 // power-of-two buckets of nanoseconds
+
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+
+typedef int (*MutexFunc)(pthread_mutex_t *);
+
+static MutexFunc real_lock;
+static MutexFunc real_trylock;
+static MutexFunc real_unlock;
+static MutexFunc real_destroy;
+
+static bool order_mode = true;
+static bool stats_mode = false;
+static bool abort_on_cycle = false;
+static int report_top = 10;
+
+struct Stack {
+  int depth;
+  void *frames[MAX_FRAMES];
+};
+
+struct HeldLock {
+  pthread_mutex_t *mutex;
+  uint64_t acquired_ns;
+  struct Stack stack; // where it was taken, order mode only
+};
+
+// The thread's currently held mutexes, innermost last
+static TLS struct HeldLock held[MAX_HELD];
+static TLS int held_num;
+// Set while a hook runs, so locks taken by the hook itself (stdio,
+// backtrace) pass straight through
+static TLS bool in_hook;
+
+// Lock-order graph: a node per mutex, edges chained per source node
+struct Node {
+  pthread_mutex_t *mutex;
+  int first_edge; // -1 when none
+  unsigned visited;
+};
+
+struct Edge {
+  int from;
+  int to;
+  int next;
+  bool dead;
+  struct Stack from_stack; // where `from` was taken
+  struct Stack to_stack;   // where `to` was taken while `from` was held
+};
+
+static struct SpinLock graph_lock;
+static struct Node nodes[MAX_NODES];
+static int nodes_used;
+static struct Edge edges[MAX_EDGES];
+static int edges_num;
+static unsigned visit_stamp;
+static atomic_ulong cycles_found;
+
+// Per-mutex timing, claimed by CAS on the address so no lock is needed
+struct MutexStats {
+  _Atomic(pthread_mutex_t *) mutex;
+  atomic_ulong acquisitions;
+  atomic_ulong contended;
+  atomic_ulong wait_ns;
+  atomic_ulong wait_max_ns;
+  atomic_ulong hold_ns;
+  atomic_ulong hold_max_ns;
+  atomic_ulong wait_hist[HIST_BUCKETS];
+  atomic_ulong hold_hist[HIST_BUCKETS];
+};
+
+static struct MutexStats stats[MAX_STATS];
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t HashPointer(const void *p, size_t size) {
+  uintptr_t x = (uintptr_t)p;
+  x ^= x >> 17;
+  x *= 0xed5ad4bbU;
+  x ^= x >> 11;
+  return x % size;
+}
+
+static void ResolveReal(void) {
+  real_lock = (MutexFunc)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+  real_trylock = (MutexFunc)dlsym(RTLD_NEXT, "pthread_mutex_trylock");
+  real_unlock = (MutexFunc)dlsym(RTLD_NEXT, "pthread_mutex_unlock");
+  real_destroy = (MutexFunc)dlsym(RTLD_NEXT, "pthread_mutex_destroy");
+}
+
+__attribute__((noinline)) static void CaptureStack(struct Stack *stack) {
+  // Skip this function and the hook
+  void *frames[MAX_FRAMES + 2];
+  int depth = backtrace(frames, MAX_FRAMES + 2);
+  stack->depth = depth > 2 ? depth - 2 : 0;
+  memcpy(stack->frames, frames + 2, stack->depth * sizeof(void *));
+}
+
+static void PrintStack(const char *title, const struct Stack *stack) {
+  dprintf(2, "  %s:\n", title);
+  backtrace_symbols_fd((void *const *)stack->frames, stack->depth, 2);
+}
+
+// ---- order mode ----------------------------------------------------------
+
+// Returns the node of mutex, creating it; -1 if the table is full.
+// Called with graph_lock held.
+static int FindNode(pthread_mutex_t *mutex, bool create) {
+  size_t i = HashPointer(mutex, MAX_NODES);
+  for (size_t probe = 0; probe < MAX_NODES; probe++) {
+    struct Node *node = &nodes[(i + probe) % MAX_NODES];
+    if (node->mutex == mutex)
+      return (int)((i + probe) % MAX_NODES);
+    if (node->mutex == NULL) {
+      if (!create || nodes_used >= MAX_NODES * 3 / 4)
+        return -1;
+      node->mutex = mutex;
+      node->first_edge = -1;
+      nodes_used++;
+      return (int)((i + probe) % MAX_NODES);
+    }
+  }
+  return -1;
+}
+
+static int FindEdge(int from, int to) {
+  for (int e = nodes[from].first_edge; e >= 0; e = edges[e].next) {
+    if (edges[e].to == to && !edges[e].dead)
+      return e;
+  }
+  return -1;
+}
+
+// Depth-first search for a path from -> to; fills path[] with the edges
+// and returns its length, 0 if there is none.
+static int FindPath(int from, int to, int *path, int max_path) {
+  int stack_edges[MAX_HELD * 4];
+  int depth = 0;
+  visit_stamp++;
+  nodes[from].visited = visit_stamp;
+  stack_edges[0] = nodes[from].first_edge;
+
+  while (depth >= 0) {
+    int e = stack_edges[depth];
+    if (e < 0) {
+      depth--;
+      continue;
+    }
+    stack_edges[depth] = edges[e].next;
+    if (edges[e].dead)
+      continue;
+    int next = edges[e].to;
+    path[depth] = e;
+    if (next == to)
+      return depth + 1;
+    if (nodes[next].visited == visit_stamp || depth + 1 >= max_path ||
+        depth + 1 >= MAX_HELD * 4)
+      continue;
+    nodes[next].visited = visit_stamp;
+    depth++;
+    stack_edges[depth] = nodes[next].first_edge;
+  }
+  return 0;
+}
+
+static void ReportCycle(pthread_mutex_t *held_mutex, pthread_mutex_t *mutex,
+                        const struct Stack *held_stack,
+                        const struct Stack *stack, const int *path,
+                        int path_len) {
+  atomic_fetch_add(&cycles_found, 1);
+  dprintf(2,
+          "lockdep: possible deadlock, thread %d acquires %p while holding "
+          "%p, but the opposite order was seen before\n",
+          (int)gettid(), (void *)mutex, (void *)held_mutex);
+  PrintStack("holding lock taken at", held_stack);
+  PrintStack("acquiring lock at", stack);
+  for (int i = 0; i < path_len; i++) {
+    const struct Edge *edge = &edges[path[i]];
+    dprintf(2, "  existing order %p -> %p:\n", (void *)nodes[edge->from].mutex,
+            (void *)nodes[edge->to].mutex);
+    PrintStack("first lock taken at", &edge->from_stack);
+    PrintStack("second lock taken at", &edge->to_stack);
+  }
+  if (abort_on_cycle)
+    abort();
+}
+
+static void CheckOrder(pthread_mutex_t *mutex, const struct Stack *stack) {
+  SpinLockAcquire(&graph_lock);
+  int to = FindNode(mutex, true);
+  for (int h = 0; h < held_num && to >= 0; h++) {
+    if (held[h].mutex == mutex)
+      continue; // recursive mutex
+    int from = FindNode(held[h].mutex, true);
+    if (from < 0 || FindEdge(from, to) >= 0)
+      continue;
+
+    int path[MAX_HELD * 4];
+    int path_len = FindPath(to, from, path, MAX_HELD * 4);
+    if (path_len > 0)
+      ReportCycle(held[h].mutex, mutex, &held[h].stack, stack, path,
+                  path_len);
+
+    if (edges_num < MAX_EDGES) {
+      struct Edge *edge = &edges[edges_num];
+      edge->from = from;
+      edge->to = to;
+      edge->dead = false;
+      edge->from_stack = held[h].stack;
+      edge->to_stack = *stack;
+      edge->next = nodes[from].first_edge;
+      nodes[from].first_edge = edges_num++;
+    }
+  }
+  SpinLockRelease(&graph_lock);
+}
+
+// A destroyed mutex's address may be reused by an unrelated one: forget
+// every edge touching it
+static void ForgetMutex(pthread_mutex_t *mutex) {
+  SpinLockAcquire(&graph_lock);
+  int node = FindNode(mutex, false);
+  if (node >= 0) {
+    for (int e = 0; e < edges_num; e++) {
+      if (edges[e].from == node || edges[e].to == node)
+        edges[e].dead = true;
+    }
+  }
+  SpinLockRelease(&graph_lock);
+}
+
+// ---- stats mode ----------------------------------------------------------
+
+static struct MutexStats *FindStats(pthread_mutex_t *mutex) {
+  size_t i = HashPointer(mutex, MAX_STATS);
+  for (size_t probe = 0; probe < MAX_STATS; probe++) {
+    struct MutexStats *s = &stats[(i + probe) % MAX_STATS];
+    pthread_mutex_t *owner = atomic_load_explicit(&s->mutex,
+                                                  memory_order_acquire);
+    if (owner == mutex)
+      return s;
+    if (owner == NULL) {
+      pthread_mutex_t *expected = NULL;
+      if (atomic_compare_exchange_strong(&s->mutex, &expected, mutex) ||
+          expected == mutex)
+        return s;
+    }
+  }
+  return NULL;
+}
+
+static int Bucket(uint64_t ns) {
+  int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+  return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+static void UpdateMax(atomic_ulong *max, uint64_t value) {
+  unsigned long old = atomic_load_explicit(max, memory_order_relaxed);
+  while (value > old && !atomic_compare_exchange_weak_explicit(
+                            max, &old, value, memory_order_relaxed,
+                            memory_order_relaxed))
+    ;
+}
+
+static void RecordWait(pthread_mutex_t *mutex, uint64_t wait_ns,
+                       bool contended) {
+  struct MutexStats *s = FindStats(mutex);
+  if (s == NULL)
+    return;
+  atomic_fetch_add_explicit(&s->acquisitions, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&s->wait_hist[Bucket(wait_ns)], 1,
+                            memory_order_relaxed);
+  if (contended) {
+    atomic_fetch_add_explicit(&s->contended, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->wait_ns, wait_ns, memory_order_relaxed);
+    UpdateMax(&s->wait_max_ns, wait_ns);
+  }
+}
+
+static void RecordHold(pthread_mutex_t *mutex, uint64_t hold_ns) {
+  struct MutexStats *s = FindStats(mutex);
+  if (s == NULL)
+    return;
+  atomic_fetch_add_explicit(&s->hold_ns, hold_ns, memory_order_relaxed);
+  atomic_fetch_add_explicit(&s->hold_hist[Bucket(hold_ns)], 1,
+                            memory_order_relaxed);
+  UpdateMax(&s->hold_max_ns, hold_ns);
+}
+
+static void PrintHistogram(const char *title, atomic_ulong *hist) {
+  dprintf(2, "    %s:", title);
+  for (int b = 0; b < HIST_BUCKETS; b++) {
+    unsigned long count = atomic_load(&hist[b]);
+    if (count == 0)
+      continue;
+    // Bucket b holds [2^(b-1), 2^b) ns
+    uint64_t upper = 1ULL << b;
+    if (b == 0)
+      dprintf(2, " 0:%lu", count);
+    else if (upper < 1000)
+      dprintf(2, " <%lluns:%lu", (unsigned long long)upper, count);
+    else if (upper < 1000000)
+      dprintf(2, " <%lluus:%lu", (unsigned long long)upper / 1000, count);
+    else
+      dprintf(2, " <%llums:%lu", (unsigned long long)upper / 1000000, count);
+  }
+  dprintf(2, "\n");
+}
+
+static int CompareWait(const void *a, const void *b) {
+  unsigned long x = atomic_load(&stats[*(const int *)a].wait_ns);
+  unsigned long y = atomic_load(&stats[*(const int *)b].wait_ns);
+  return (x < y) - (x > y);
+}
+
+static void PrintStats(void) {
+  static int order[MAX_STATS];
+  int used = 0;
+  for (int i = 0; i < MAX_STATS; i++) {
+    if (atomic_load(&stats[i].mutex) != NULL)
+      order[used++] = i;
+  }
+  qsort(order, used, sizeof(int), CompareWait);
+
+  dprintf(2, "lockdep: %d mutexes, most waited on first\n", used);
+  for (int i = 0; i < used && i < report_top; i++) {
+    struct MutexStats *s = &stats[order[i]];
+    unsigned long acquisitions = atomic_load(&s->acquisitions);
+    dprintf(2,
+            "  %p: %lu acquisitions, %lu contended (%.1f%%), wait total "
+            "%.3f ms max %.1f us, hold total %.3f ms max %.1f us\n",
+            (void *)atomic_load(&s->mutex), acquisitions,
+            atomic_load(&s->contended),
+            acquisitions ? 100.0 * atomic_load(&s->contended) / acquisitions
+                         : 0.0,
+            atomic_load(&s->wait_ns) / 1e6, atomic_load(&s->wait_max_ns) / 1e3,
+            atomic_load(&s->hold_ns) / 1e6, atomic_load(&s->hold_max_ns) / 1e3);
+    PrintHistogram("wait", s->wait_hist);
+    PrintHistogram("hold", s->hold_hist);
+  }
+}
+
+// ---- hooks ---------------------------------------------------------------
+
+static void PushHeld(pthread_mutex_t *mutex, uint64_t now,
+                     const struct Stack *stack) {
+  if (held_num == MAX_HELD)
+    return;
+  held[held_num].mutex = mutex;
+  held[held_num].acquired_ns = now;
+  if (stack != NULL)
+    held[held_num].stack = *stack;
+  else
+    held[held_num].stack.depth = 0;
+  held_num++;
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  if (real_lock == NULL)
+    ResolveReal();
+  if (in_hook)
+    return real_lock(mutex);
+  in_hook = true;
+
+  struct Stack stack;
+  if (order_mode) {
+    CaptureStack(&stack);
+    CheckOrder(mutex, &stack);
+  }
+
+  int result;
+  uint64_t now = 0;
+  if (stats_mode) {
+    // Uncontended acquisitions cost one clock read, for the hold time
+    result = real_trylock(mutex);
+    bool contended = result == EBUSY;
+    uint64_t started = NowNs();
+    if (contended)
+      result = real_lock(mutex);
+    now = contended ? NowNs() : started;
+    if (result == 0)
+      RecordWait(mutex, now - started, contended);
+  } else {
+    result = real_lock(mutex);
+  }
+
+  if (result == 0)
+    PushHeld(mutex, now, order_mode ? &stack : NULL);
+  in_hook = false;
+  return result;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+  if (real_trylock == NULL)
+    ResolveReal();
+  if (in_hook)
+    return real_trylock(mutex);
+  in_hook = true;
+
+  // A trylock cannot deadlock, so it adds no order edges
+  int result = real_trylock(mutex);
+  if (result == 0) {
+    uint64_t now = stats_mode ? NowNs() : 0;
+    if (stats_mode)
+      RecordWait(mutex, 0, false);
+    struct Stack stack;
+    if (order_mode)
+      CaptureStack(&stack);
+    PushHeld(mutex, now, order_mode ? &stack : NULL);
+  }
+  in_hook = false;
+  return result;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+  if (real_unlock == NULL)
+    ResolveReal();
+  if (in_hook)
+    return real_unlock(mutex);
+  in_hook = true;
+
+  // Usually the innermost one, but unlock order is not enforced
+  for (int h = held_num - 1; h >= 0; h--) {
+    if (held[h].mutex != mutex)
+      continue;
+    if (stats_mode)
+      RecordHold(mutex, NowNs() - held[h].acquired_ns);
+    memmove(&held[h], &held[h + 1], (held_num - h - 1) * sizeof(held[0]));
+    held_num--;
+    break;
+  }
+
+  int result = real_unlock(mutex);
+  in_hook = false;
+  return result;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex) {
+  if (real_destroy == NULL)
+    ResolveReal();
+  if (!in_hook && order_mode) {
+    in_hook = true;
+    ForgetMutex(mutex);
+    in_hook = false;
+  }
+  return real_destroy(mutex);
+}
+
+__attribute__((constructor)) static void LockdepInit(void) {
+  ResolveReal();
+  const char *mode = getenv("LOCKDEP_MODE");
+  if (mode != NULL) {
+    order_mode = strcmp(mode, "order") == 0 || strcmp(mode, "all") == 0;
+    stats_mode = strcmp(mode, "stats") == 0 || strcmp(mode, "all") == 0;
+  }
+  const char *abort_env = getenv("LOCKDEP_ABORT");
+  abort_on_cycle = abort_env != NULL && atoi(abort_env) != 0;
+  const char *top = getenv("LOCKDEP_TOP");
+  if (top != NULL && atoi(top) > 0)
+    report_top = atoi(top);
+
+  // The first backtrace() loads libgcc_s; do it now and not under the
+  // graph lock
+  void *frame;
+  backtrace(&frame, 1);
+}
+
+__attribute__((destructor)) static void LockdepFini(void) {
+  in_hook = true;
+  if (order_mode)
+    dprintf(2, "lockdep: %d mutexes, %d order edges, %lu possible deadlocks\n",
+            nodes_used, edges_num, atomic_load(&cycles_found));
+  if (stats_mode)
+    PrintStats();
+}
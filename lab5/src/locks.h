@@ -0,0 +1,102 @@
+#ifndef LOCKS_H
+#define LOCKS_H
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define CACHE_LINE 64
+
+// Busy-wait helper: a pause hint on x86 and a yield every 1024 rounds, so
+// a waiter that outnumbers the CPUs lets the lock holder run instead of
+// burning its whole time slice.
+static inline void SpinWait(unsigned *spins) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+  if (++*spins % 1024 == 0)
+    sched_yield();
+}
+
+// Test-and-test-and-set lock: waiters spin on a plain load and only try
+// the exchange when the lock looks free.
+struct SpinLock {
+  atomic_int locked;
+} __attribute__((aligned(CACHE_LINE)));
+
+static inline void SpinLockAcquire(struct SpinLock *lock) {
+  unsigned spins = 0;
+  while (atomic_exchange_explicit(&lock->locked, 1, memory_order_acquire)) {
+    while (atomic_load_explicit(&lock->locked, memory_order_relaxed))
+      SpinWait(&spins);
+  }
+}
+
+static inline void SpinLockRelease(struct SpinLock *lock) {
+  atomic_store_explicit(&lock->locked, 0, memory_order_release);
+}
+
+// Ticket lock: FIFO handoff, every waiter spins on the same serving word.
+struct TicketLock {
+  atomic_uint next;
+  atomic_uint serving;
+} __attribute__((aligned(CACHE_LINE)));
+
+static inline void TicketLockAcquire(struct TicketLock *lock) {
+  unsigned ticket =
+      atomic_fetch_add_explicit(&lock->next, 1, memory_order_relaxed);
+  unsigned spins = 0;
+  while (atomic_load_explicit(&lock->serving, memory_order_acquire) != ticket)
+    SpinWait(&spins);
+}
+
+static inline void TicketLockRelease(struct TicketLock *lock) {
+  unsigned serving =
+      atomic_load_explicit(&lock->serving, memory_order_relaxed);
+  atomic_store_explicit(&lock->serving, serving + 1, memory_order_release);
+}
+
+// MCS queue lock: FIFO like the ticket lock, but every waiter spins on its
+// own node, so a release touches one remote cache line instead of all.
+// The node must stay valid from acquire until release returns.
+struct McsNode {
+  _Atomic(struct McsNode *) next;
+  atomic_int locked;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct McsLock {
+  _Atomic(struct McsNode *) tail;
+} __attribute__((aligned(CACHE_LINE)));
+
+static inline void McsLockAcquire(struct McsLock *lock, struct McsNode *node) {
+  atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+  atomic_store_explicit(&node->locked, 1, memory_order_relaxed);
+  struct McsNode *prev =
+      atomic_exchange_explicit(&lock->tail, node, memory_order_acq_rel);
+  if (prev == NULL)
+    return;
+  atomic_store_explicit(&prev->next, node, memory_order_release);
+  unsigned spins = 0;
+  while (atomic_load_explicit(&node->locked, memory_order_acquire))
+    SpinWait(&spins);
+}
+
+static inline void McsLockRelease(struct McsLock *lock, struct McsNode *node) {
+  struct McsNode *next =
+      atomic_load_explicit(&node->next, memory_order_acquire);
+  if (next == NULL) {
+    struct McsNode *expected = node;
+    if (atomic_compare_exchange_strong_explicit(&lock->tail, &expected, NULL,
+                                                memory_order_acq_rel,
+                                                memory_order_relaxed))
+      return;
+    // A successor swapped the tail but has not linked itself yet
+    unsigned spins = 0;
+    while ((next = atomic_load_explicit(&node->next, memory_order_acquire)) ==
+           NULL)
+      SpinWait(&spins);
+  }
+  atomic_store_explicit(&next->locked, 0, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * parallel_factorial.c
+ *
+ * k! mod `mod` computed by pnum threads (lab 5, task 2), e.g.
+ *   ./parallel_factorial -k 10 --pnum=4 --mod=10
+ * The range arithmetic is the lab6 factorial engine; what this program
+ * compares is how the partial products of the threads are combined.
+ */
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "factorial_combine.h"
+
+int main(int argc, char **argv) {
+  uint64_t k = 0;
+  uint64_t mod = 0;
+  int pnum = -1;
+  int repeat = 1;
+  bool enabled[COMBINE_STRATEGIES_NUM];
+  for (int s = 0; s < COMBINE_STRATEGIES_NUM; s++)
+    enabled[s] = true;
+
+  while (true) {
+    static struct option options[] = {{"k", required_argument, 0, 'k'},
+                                      {"pnum", required_argument, 0, 0},
+                                      {"mod", required_argument, 0, 0},
+                                      {"strategy", required_argument, 0, 0},
+                                      {"repeat", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "k:", options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 'k':
+      k = strtoull(optarg, NULL, 10);
+      break;
+    case 0:
+      switch (option_index) {
+      case 1:
+        pnum = atoi(optarg);
+        break;
+      case 2:
+        mod = strtoull(optarg, NULL, 10);
+        break;
+      case 3:
+        for (int s = 0; s < COMBINE_STRATEGIES_NUM; s++)
+          enabled[s] =
+              strstr(optarg, CombineStrategyName((enum CombineStrategy)s)) !=
+              NULL;
+        break;
+      case 4:
+        repeat = atoi(optarg);
+        break;
+      }
+      break;
+
+    case '?':
+      printf("Arguments error\n");
+      break;
+    }
+  }
+
+  if (k == 0 || mod == 0 || pnum <= 0 || repeat <= 0) {
+    fprintf(stderr,
+            "Using: %s -k 10 --pnum=4 --mod=10 [--strategy mutex,cas,tree] "
+            "[--repeat 1]\n",
+            argv[0]);
+    return 1;
+  }
+
+  struct FactorialArgs args = {.begin = 1, .end = k, .mod = mod};
+  uint64_t expected = Factorial(&args);
+  printf("%" PRIu64 "! mod %" PRIu64 " = %" PRIu64 ", pnum %d\n", k, mod,
+         expected, pnum);
+  printf("strategy    total us   compute us   combine us\n");
+
+  bool ok = true;
+  for (int s = 0; s < COMBINE_STRATEGIES_NUM; s++) {
+    if (!enabled[s])
+      continue;
+    // Best of repeat runs: thread start-up noise only ever adds time
+    struct CombineTiming best = {0};
+    for (int r = 0; r < repeat; r++) {
+      struct CombineTiming timing;
+      uint64_t result =
+          ParallelFactorial(&args, pnum, (enum CombineStrategy)s, &timing);
+      if (result != expected) {
+        printf("%-8s wrong answer %" PRIu64 "\n",
+               CombineStrategyName((enum CombineStrategy)s), result);
+        ok = false;
+        break;
+      }
+      if (r == 0 || timing.total_us < best.total_us)
+        best = timing;
+    }
+    printf("%-8s %11.1f %12.1f %12.1f\n",
+           CombineStrategyName((enum CombineStrategy)s), best.total_us,
+           best.compute_us, best.combine_us);
+  }
+  return ok ? 0 : 1;
+}
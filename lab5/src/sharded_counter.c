@@ -0,0 +1,125 @@
+#define _GNU_SOURCE
+#include "sharded_counter.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define HAVE_RSEQ 1
+#endif
+#endif
+
+struct ShardedCounter {
+  int capacity;
+  atomic_int registered;
+  struct CounterSlot *slots;
+};
+
+struct PerCpuCounter {
+  int cpus;
+  struct CounterSlot *slots;
+};
+
+static struct CounterSlot *AllocSlots(int count) {
+  struct CounterSlot *slots =
+      aligned_alloc(CACHE_LINE, count * sizeof(struct CounterSlot));
+  if (slots != NULL)
+    memset(slots, 0, count * sizeof(struct CounterSlot));
+  return slots;
+}
+
+static long SumSlots(const struct CounterSlot *slots, int count) {
+  long sum = 0;
+  for (int i = 0; i < count; i++)
+    sum += atomic_load_explicit(&((struct CounterSlot *)slots)[i].value,
+                                memory_order_relaxed);
+  return sum;
+}
+
+struct ShardedCounter *ShardedCounterCreate(int max_threads) {
+  if (max_threads <= 0)
+    return NULL;
+  struct ShardedCounter *counter = calloc(1, sizeof(struct ShardedCounter));
+  if (counter == NULL)
+    return NULL;
+  counter->slots = AllocSlots(max_threads);
+  if (counter->slots == NULL) {
+    free(counter);
+    return NULL;
+  }
+  counter->capacity = max_threads;
+  return counter;
+}
+
+struct CounterSlot *ShardedCounterRegister(struct ShardedCounter *counter) {
+  int index = atomic_fetch_add(&counter->registered, 1);
+  if (index >= counter->capacity)
+    return NULL;
+  return &counter->slots[index];
+}
+
+long ShardedCounterRead(const struct ShardedCounter *counter) {
+  return SumSlots(counter->slots, counter->capacity);
+}
+
+void ShardedCounterDestroy(struct ShardedCounter *counter) {
+  if (counter == NULL)
+    return;
+  free(counter->slots);
+  free(counter);
+}
+
+struct PerCpuCounter *PerCpuCounterCreate(void) {
+  struct PerCpuCounter *counter = calloc(1, sizeof(struct PerCpuCounter));
+  if (counter == NULL)
+    return NULL;
+  // Configured rather than online CPUs: a CPU brought online later must
+  // still have a slot
+  long cpus = sysconf(_SC_NPROCESSORS_CONF);
+  counter->cpus = cpus > 0 ? (int)cpus : 1;
+  counter->slots = AllocSlots(counter->cpus);
+  if (counter->slots == NULL) {
+    free(counter);
+    return NULL;
+  }
+  return counter;
+}
+
+static inline int CurrentCpu(void) {
+#ifdef HAVE_RSEQ
+  // The kernel keeps cpu_id of the registered rseq area up to date on
+  // every migration, so this is a plain load instead of a system call
+  if (__rseq_size > 0) {
+    const struct rseq *rs =
+        (const struct rseq *)((char *)__builtin_thread_pointer() +
+                              __rseq_offset);
+    int cpu = (int)*(volatile const __u32 *)&rs->cpu_id;
+    if (cpu >= 0)
+      return cpu;
+  }
+#endif
+  return sched_getcpu();
+}
+
+void PerCpuCounterAdd(struct PerCpuCounter *counter, long delta) {
+  int cpu = CurrentCpu();
+  if (cpu < 0 || cpu >= counter->cpus)
+    cpu = 0;
+  atomic_fetch_add_explicit(&counter->slots[cpu].value, delta,
+                            memory_order_relaxed);
+}
+
+long PerCpuCounterRead(const struct PerCpuCounter *counter) {
+  return SumSlots(counter->slots, counter->cpus);
+}
+
+void PerCpuCounterDestroy(struct PerCpuCounter *counter) {
+  if (counter == NULL)
+    return;
+  free(counter->slots);
+  free(counter);
+}
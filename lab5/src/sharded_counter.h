@@ -0,0 +1,52 @@
+#ifndef SHARDED_COUNTER_H
+#define SHARDED_COUNTER_H
+
+#include <stdatomic.h>
+
+#include "locks.h"
+
+// One shard of a counter, alone on its cache line so that writers of
+// neighbouring shards never invalidate each other's line.
+struct CounterSlot {
+  atomic_long value;
+} __attribute__((aligned(CACHE_LINE)));
+
+// Per-thread sharded counter: every thread registers once and gets a slot
+// nobody else writes, so an increment is a plain relaxed load and store.
+// Readers sum all slots on demand; the sum is exact once the writers have
+// stopped and never runs backwards while they are running.
+struct ShardedCounter;
+
+struct ShardedCounter *ShardedCounterCreate(int max_threads);
+
+// Returns the calling thread's slot, or NULL when max_threads slots are
+// already taken. The slot must only be written by the thread that got it.
+struct CounterSlot *ShardedCounterRegister(struct ShardedCounter *counter);
+
+static inline void CounterSlotAdd(struct CounterSlot *slot, long delta) {
+  atomic_store_explicit(
+      &slot->value,
+      atomic_load_explicit(&slot->value, memory_order_relaxed) + delta,
+      memory_order_relaxed);
+}
+
+long ShardedCounterRead(const struct ShardedCounter *counter);
+
+void ShardedCounterDestroy(struct ShardedCounter *counter);
+
+// Per-CPU counter: no registration, the slot is picked by the CPU the
+// thread runs on, read from the kernel-maintained rseq area when glibc
+// registered one. The thread may migrate between reading the CPU and
+// adding, so the add is an atomic fetch_add; it is uncontended unless
+// that actually happens.
+struct PerCpuCounter;
+
+struct PerCpuCounter *PerCpuCounterCreate(void);
+
+void PerCpuCounterAdd(struct PerCpuCounter *counter, long delta);
+
+long PerCpuCounterRead(const struct PerCpuCounter *counter);
+
+void PerCpuCounterDestroy(struct PerCpuCounter *counter);
+
+#endif
@@ -0,0 +1,220 @@
+#include "cache.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "multmodulo.h"
+
+#define CACHE_SHARDS 16
+
+struct CacheEntry {
+  uint64_t mod;
+  uint64_t block;
+  uint64_t product;
+  struct CacheEntry *chain; // next in the hash bucket
+  struct CacheEntry *prev;  // LRU list, most recently used first
+  struct CacheEntry *next;
+};
+
+struct CacheShard {
+  pthread_mutex_t mutex;
+  struct CacheEntry **buckets;
+  size_t buckets_mask;
+  size_t entries;
+  size_t capacity;
+  struct CacheEntry lru; // sentinel of the circular LRU list
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} __attribute__((aligned(64)));
+
+struct FactorialCache {
+  struct CacheShard shards[CACHE_SHARDS];
+};
+
+static uint64_t HashKey(uint64_t mod, uint64_t block) {
+  uint64_t h = mod * 0x9E3779B97F4A7C15ull ^ block;
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDull;
+  h ^= h >> 33;
+  return h;
+}
+
+static void LruUnlink(struct CacheEntry *entry) {
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+}
+
+static void LruPushFront(struct CacheShard *shard, struct CacheEntry *entry) {
+  entry->prev = &shard->lru;
+  entry->next = shard->lru.next;
+  shard->lru.next->prev = entry;
+  shard->lru.next = entry;
+}
+
+static struct CacheEntry **FindSlot(struct CacheShard *shard, uint64_t hash,
+                                    uint64_t mod, uint64_t block) {
+  struct CacheEntry **slot = &shard->buckets[(hash >> 8) & shard->buckets_mask];
+  while (*slot && ((*slot)->mod != mod || (*slot)->block != block))
+    slot = &(*slot)->chain;
+  return slot;
+}
+
+static void EvictOldest(struct CacheShard *shard) {
+  struct CacheEntry *oldest = shard->lru.prev;
+  uint64_t hash = HashKey(oldest->mod, oldest->block);
+  struct CacheEntry **slot = FindSlot(shard, hash, oldest->mod, oldest->block);
+  *slot = oldest->chain;
+  LruUnlink(oldest);
+  free(oldest);
+  shard->entries--;
+  shard->evictions++;
+}
+
+struct FactorialCache *FactorialCacheCreate(size_t max_bytes) {
+  size_t per_shard = max_bytes / CACHE_SHARDS / sizeof(struct CacheEntry);
+  if (per_shard == 0)
+    return NULL;
+
+  struct FactorialCache *cache = aligned_alloc(64, sizeof(struct FactorialCache));
+  if (cache == NULL)
+    return NULL;
+
+  // Bucket array sized for a load factor <= 1 at full capacity; it is
+  // counted against max_bytes too
+  size_t buckets = 1;
+  while (buckets < per_shard)
+    buckets <<= 1;
+  per_shard -= buckets * sizeof(struct CacheEntry *) / sizeof(struct CacheEntry);
+  if (per_shard == 0)
+    per_shard = 1;
+
+  for (int i = 0; i < CACHE_SHARDS; i++) {
+    struct CacheShard *shard = &cache->shards[i];
+    pthread_mutex_init(&shard->mutex, NULL);
+    shard->buckets = calloc(buckets, sizeof(struct CacheEntry *));
+    if (shard->buckets == NULL) {
+      for (int j = 0; j < i; j++)
+        free(cache->shards[j].buckets);
+      free(cache);
+      return NULL;
+    }
+    shard->buckets_mask = buckets - 1;
+    shard->entries = 0;
+    shard->capacity = per_shard;
+    shard->lru.prev = shard->lru.next = &shard->lru;
+    shard->hits = shard->misses = shard->evictions = 0;
+  }
+  return cache;
+}
+
+// Product of block `block` modulo mod, computed on a miss
+static uint64_t BlockProduct(struct FactorialCache *cache, uint64_t mod,
+                             uint64_t block) {
+  uint64_t hash = HashKey(mod, block);
+  struct CacheShard *shard = &cache->shards[hash % CACHE_SHARDS];
+
+  pthread_mutex_lock(&shard->mutex);
+  struct CacheEntry *entry = *FindSlot(shard, hash, mod, block);
+  if (entry) {
+    shard->hits++;
+    LruUnlink(entry);
+    LruPushFront(shard, entry);
+    uint64_t product = entry->product;
+    pthread_mutex_unlock(&shard->mutex);
+    return product;
+  }
+  shard->misses++;
+  pthread_mutex_unlock(&shard->mutex);
+
+  // Computed without the lock; two threads missing the same block at once
+  // both compute it and the second insert is dropped
+  struct FactorialArgs args = {block * FACTORIAL_CACHE_BLOCK + 1,
+                               (block + 1) * FACTORIAL_CACHE_BLOCK, mod};
+  uint64_t product = Factorial(&args);
+
+  struct CacheEntry *fresh = malloc(sizeof(struct CacheEntry));
+  if (fresh == NULL)
+    return product;
+  fresh->mod = mod;
+  fresh->block = block;
+  fresh->product = product;
+
+  pthread_mutex_lock(&shard->mutex);
+  struct CacheEntry **slot = FindSlot(shard, hash, mod, block);
+  if (*slot) {
+    free(fresh);
+  } else {
+    if (shard->entries == shard->capacity) {
+      EvictOldest(shard);
+      slot = FindSlot(shard, hash, mod, block);
+    }
+    fresh->chain = NULL;
+    *slot = fresh;
+    LruPushFront(shard, fresh);
+    shard->entries++;
+  }
+  pthread_mutex_unlock(&shard->mutex);
+  return product;
+}
+
+uint64_t CachedFactorial(struct FactorialCache *cache,
+                         const struct FactorialArgs *args) {
+  uint64_t begin = args->begin;
+  uint64_t end = args->end;
+  uint64_t mod = args->mod;
+  if (cache == NULL || mod <= 1 || begin > end || begin == 0)
+    return Factorial(args);
+
+  // Whole blocks inside [begin, end]; block b is [b * B + 1, (b + 1) * B]
+  uint64_t first = (begin - 1 + FACTORIAL_CACHE_BLOCK - 1) / FACTORIAL_CACHE_BLOCK;
+  uint64_t last = end / FACTORIAL_CACHE_BLOCK; // one past the last block
+  if (first >= last)
+    return Factorial(args);
+
+  uint64_t head_end = first * FACTORIAL_CACHE_BLOCK;
+  uint64_t tail_begin = last * FACTORIAL_CACHE_BLOCK + 1;
+  struct FactorialArgs head = {begin, head_end, mod};
+  struct FactorialArgs tail = {tail_begin, end, mod};
+
+  uint64_t result = MultModulo(Factorial(&head), Factorial(&tail), mod);
+  for (uint64_t block = first; block < last && result != 0; block++)
+    result = MultModulo(result, BlockProduct(cache, mod, block), mod);
+  return result;
+}
+
+void FactorialCacheGetStats(struct FactorialCache *cache,
+                            struct FactorialCacheStats *stats) {
+  stats->hits = stats->misses = stats->evictions = 0;
+  stats->entries = 0;
+  for (int i = 0; i < CACHE_SHARDS; i++) {
+    struct CacheShard *shard = &cache->shards[i];
+    pthread_mutex_lock(&shard->mutex);
+    stats->hits += shard->hits;
+    stats->misses += shard->misses;
+    stats->evictions += shard->evictions;
+    stats->entries += shard->entries;
+    pthread_mutex_unlock(&shard->mutex);
+  }
+  stats->bytes = stats->entries * sizeof(struct CacheEntry) +
+                 CACHE_SHARDS * (cache->shards[0].buckets_mask + 1) *
+                     sizeof(struct CacheEntry *);
+}
+
+void FactorialCacheDestroy(struct FactorialCache *cache) {
+  if (cache == NULL)
+    return;
+  for (int i = 0; i < CACHE_SHARDS; i++) {
+    struct CacheShard *shard = &cache->shards[i];
+    struct CacheEntry *entry = shard->lru.next;
+    while (entry != &shard->lru) {
+      struct CacheEntry *next = entry->next;
+      free(entry);
+      entry = next;
+    }
+    free(shard->buckets);
+    pthread_mutex_destroy(&shard->mutex);
+  }
+  free(cache);
+}
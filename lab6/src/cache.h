@@ -0,0 +1,40 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "factorial.h"
+
+// Products of whole blocks [b * BLOCK + 1, (b + 1) * BLOCK] modulo mod,
+// keyed by (mod, b). A range query multiplies the cached products of the
+// blocks it covers and scans only the partial blocks at its edges.
+// Products are stored per block rather than as prefix products from 1:
+// going from prefixes back to an arbitrary range needs a modular inverse,
+// which does not exist for composite moduli.
+#define FACTORIAL_CACHE_BLOCK 4096
+
+struct FactorialCache;
+
+struct FactorialCacheStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  size_t entries;
+  size_t bytes;
+};
+
+// The cache is split into independently locked shards, each an LRU list
+// bounded so that the whole cache stays under max_bytes.
+struct FactorialCache *FactorialCacheCreate(size_t max_bytes);
+
+// Same result as Factorial(args); cache may be NULL.
+uint64_t CachedFactorial(struct FactorialCache *cache,
+                         const struct FactorialArgs *args);
+
+void FactorialCacheGetStats(struct FactorialCache *cache,
+                            struct FactorialCacheStats *stats);
+
+void FactorialCacheDestroy(struct FactorialCache *cache);
+
+#endif
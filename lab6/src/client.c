@@ -1,7 +1,9 @@
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <errno.h>
@@ -9,46 +11,428 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include "factorial.h"
+#include "multmodulo.h"
+#include "protocol.h"
+
 struct Server {
-  char ip[255];
-  int port;
+  char *ip;
+  char *port;
+  uint64_t capacity; // relative speed, e.g. number of cores
 };
 
-uint64_t MultModulo(uint64_t a, uint64_t b, uint64_t mod) {
-  uint64_t result = 0;
-  a = a % mod;
-  while (b > 0) {
-    if (b % 2 == 1)
-      result = (result + a) % mod;
-    a = (a * 2) % mod;
-    b /= 2;
-  }
+// Chunks that may wait in one connection's pipeline; the server stops
+// reading from a connection with more frames than that in flight, and a
+// frame carries at least one chunk.
+#define MAX_DEPTH 64
+#define REQUEST_FRAME_SIZE (FRAME_HEADER_SIZE + FRAME_RANGE_SIZE)
+// The largest response: one frame answering a whole pipeline
+#define RESPONSE_MAX_SIZE (FRAME_HEADER_SIZE + MAX_DEPTH * FRAME_RESULT_SIZE)
+
+enum ChunkState { CHUNK_PENDING, CHUNK_ASSIGNED, CHUNK_DONE };
+
+// A piece of the work; one range of a request frame
+struct Chunk {
+  uint64_t begin;
+  uint64_t end;
+  uint64_t result;
+  enum ChunkState state;
+  struct Connection *owner;
+};
+
+// A request frame in flight: its id on the wire and the chunks it carries,
+// in the order of its ranges
+struct Frame {
+  bool used;
+  uint64_t id;
+  int count;
+  uint64_t chunks[MAX_DEPTH];
+};
+
+// A persistent connection to one server. It keeps up to depth chunks in
+// flight and gets new ones every time an answer comes back, so faster
+// servers end up doing more of the work. The chunks that are free at once
+// go out as one multi-range frame. Reads and writes may be partial, so
+// both directions keep an offset into their buffer.
+struct Connection {
+  struct Server *server;
+  int fd;
+  bool connected;
+  bool dead;
+  int depth;
+  int in_flight;
+  char out[MAX_DEPTH * REQUEST_FRAME_SIZE];
+  size_t out_len;
+  size_t out_sent;
+  char in[RESPONSE_MAX_SIZE];
+  size_t in_len;
+  struct Frame frames[MAX_DEPTH];
+  uint64_t chunks_done;
+  uint64_t numbers_done;
+  double finished_ms;
+};
+
+struct Scheduler {
+  struct Chunk *chunks;
+  uint64_t chunks_num;
+  uint64_t done;
+  uint64_t *pending; // stack of chunk indices waiting for a server
+  uint64_t pending_num;
+  uint64_t next_id; // id of the next request frame
+  uint64_t mod;
+  int epoll_fd;
+};
 
-  return result % mod;
+static double NowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
 }
 
 bool ConvertStringToUI64(const char *str, uint64_t *val) {
   char *end = NULL;
+  errno = 0;
   unsigned long long i = strtoull(str, &end, 10);
   if (errno == ERANGE) {
     fprintf(stderr, "Out of uint64_t range: %s\n", str);
     return false;
   }
 
-  if (errno != 0)
+  if (errno != 0 || end == str || *end != '\0')
     return false;
 
   *val = i;
   return true;
 }
 
+// Reads "ip:port [capacity]" lines; blank lines and lines starting with
+// '#' are skipped. Lines may be of any length (getline), and the port is
+// split at the last ':' so the host part may itself contain colons.
+struct Server *ReadServers(const char *path, unsigned int *servers_num) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Can not open servers file %s\n", path);
+    return NULL;
+  }
+
+  struct Server *servers = NULL;
+  unsigned int count = 0;
+  unsigned int allocated = 0;
+  char *line = NULL;
+  size_t line_size = 0;
+  unsigned int line_num = 0;
+
+  while (getline(&line, &line_size, file) != -1) {
+    line_num++;
+    char *save = NULL;
+    char *address = strtok_r(line, " \t\r\n", &save);
+    if (address == NULL || address[0] == '#')
+      continue;
+
+    char *colon = strrchr(address, ':');
+    if (colon == NULL || colon == address || colon[1] == '\0') {
+      fprintf(stderr, "%s:%u: expected ip:port, got \"%s\"\n", path, line_num,
+              address);
+      continue;
+    }
+    *colon = '\0';
+
+    uint64_t capacity = 1;
+    char *capacity_str = strtok_r(NULL, " \t\r\n", &save);
+    if (capacity_str != NULL &&
+        (!ConvertStringToUI64(capacity_str, &capacity) || capacity == 0)) {
+      fprintf(stderr, "%s:%u: bad capacity \"%s\"\n", path, line_num,
+              capacity_str);
+      continue;
+    }
+
+    if (count == allocated) {
+      allocated = allocated ? allocated * 2 : 8;
+      struct Server *grown = realloc(servers, sizeof(struct Server) * allocated);
+      if (grown == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        break;
+      }
+      servers = grown;
+    }
+    servers[count].ip = strdup(address);
+    servers[count].port = strdup(colon + 1);
+    servers[count].capacity = capacity;
+    count++;
+  }
+
+  free(line);
+  fclose(file);
+  *servers_num = count;
+  return servers;
+}
+
+void FreeServers(struct Server *servers, unsigned int servers_num) {
+  for (unsigned int i = 0; i < servers_num; i++) {
+    free(servers[i].ip);
+    free(servers[i].port);
+  }
+  free(servers);
+}
+
+// Non-blocking connect; completion is reported by epoll as EPOLLOUT
+static int StartConnect(struct Connection *conn) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  struct addrinfo *addrs = NULL;
+  int err = getaddrinfo(conn->server->ip, conn->server->port, &hints, &addrs);
+  if (err != 0) {
+    fprintf(stderr, "getaddrinfo failed with %s: %s\n", conn->server->ip,
+            gai_strerror(err));
+    return -1;
+  }
+
+  int sck = socket(addrs->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (sck < 0) {
+    fprintf(stderr, "Socket creation failed!\n");
+    freeaddrinfo(addrs);
+    return -1;
+  }
+
+  if (connect(sck, addrs->ai_addr, addrs->ai_addrlen) < 0 &&
+      errno != EINPROGRESS) {
+    fprintf(stderr, "Connection to %s:%s failed\n", conn->server->ip,
+            conn->server->port);
+    close(sck);
+    freeaddrinfo(addrs);
+    return -1;
+  }
+  freeaddrinfo(addrs);
+
+  int one = 1;
+  setsockopt(sck, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  conn->fd = sck;
+  return 0;
+}
+
+static void WatchConnection(struct Scheduler *sched, struct Connection *conn) {
+  uint32_t events = EPOLLIN;
+  if (!conn->connected || conn->out_sent < conn->out_len)
+    events |= EPOLLOUT;
+  struct epoll_event event = {.events = events, .data.ptr = conn};
+  epoll_ctl(sched->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+// Queues one request frame with as many pending chunks as the
+// connection's pipeline has room for. After a partial send, answers to the
+// frames already sent free pipeline slots while the unsent tail still
+// occupies the buffer, so the tail is moved to the front first. The buffer
+// fits depth one-range frames, and every frame with more ranges replaces
+// several of those with a single header, so it never overflows.
+static void FillPipeline(struct Scheduler *sched, struct Connection *conn) {
+  if (conn->out_sent > 0) {
+    memmove(conn->out, conn->out + conn->out_sent,
+            conn->out_len - conn->out_sent);
+    conn->out_len -= conn->out_sent;
+    conn->out_sent = 0;
+  }
+  int count = conn->depth - conn->in_flight;
+  if (count <= 0 || sched->pending_num == 0)
+    return;
+  if ((uint64_t)count > sched->pending_num)
+    count = (int)sched->pending_num;
+
+  struct Frame *frame = NULL;
+  for (int i = 0; i < MAX_DEPTH && frame == NULL; i++) {
+    if (!conn->frames[i].used)
+      frame = &conn->frames[i];
+  }
+  if (frame == NULL)
+    return; // cannot happen: each frame holds at least one in-flight chunk
+
+  struct FactorialArgs ranges[MAX_DEPTH];
+  for (int i = 0; i < count; i++) {
+    uint64_t index = sched->pending[--sched->pending_num];
+    struct Chunk *chunk = &sched->chunks[index];
+    chunk->state = CHUNK_ASSIGNED;
+    chunk->owner = conn;
+    frame->chunks[i] = index;
+    ranges[i] = (struct FactorialArgs){chunk->begin, chunk->end, sched->mod};
+  }
+  frame->used = true;
+  frame->id = sched->next_id++;
+  frame->count = count;
+  conn->out_len += EncodeRequest(conn->out + conn->out_len, frame->id, ranges,
+                                 (uint16_t)count);
+  conn->in_flight += count;
+}
+
+// Gives the chunks of a broken connection back to the others
+static void DropConnection(struct Scheduler *sched, struct Connection *conn,
+                           struct Connection *conns, unsigned int conns_num) {
+  fprintf(stderr, "Lost %s:%s, %d chunk(s) go to other servers\n",
+          conn->server->ip, conn->server->port, conn->in_flight);
+  if (conn->fd >= 0) {
+    epoll_ctl(sched->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+  }
+  conn->dead = true;
+  conn->in_flight = 0;
+  memset(conn->frames, 0, sizeof(conn->frames));
+
+  for (uint64_t i = 0; i < sched->chunks_num; i++) {
+    struct Chunk *chunk = &sched->chunks[i];
+    if (chunk->state == CHUNK_ASSIGNED && chunk->owner == conn) {
+      chunk->state = CHUNK_PENDING;
+      chunk->owner = NULL;
+      sched->pending[sched->pending_num++] = i;
+    }
+  }
+
+  for (unsigned int i = 0; i < conns_num; i++) {
+    struct Connection *other = &conns[i];
+    if (other->dead || !other->connected)
+      continue;
+    FillPipeline(sched, other);
+    WatchConnection(sched, other);
+  }
+}
+
+// Handles one complete response frame given its decoded header and its
+// payload. Returns -1 if the server sent something that does not belong
+// to this connection.
+static int HandleResponse(struct Scheduler *sched, struct Connection *conn,
+                          const struct FrameHeader *header,
+                          const char *payload) {
+  struct Frame *frame = NULL;
+  for (int i = 0; i < MAX_DEPTH && frame == NULL; i++) {
+    if (conn->frames[i].used && conn->frames[i].id == header->id)
+      frame = &conn->frames[i];
+  }
+  if (frame == NULL ||
+      (header->type == FRAME_RESPONSE && header->count != frame->count)) {
+    fprintf(stderr, "Server %s:%s sent a malformed frame\n", conn->server->ip,
+            conn->server->port);
+    return -1;
+  }
+  if (header->type == FRAME_ERROR) {
+    fprintf(stderr, "Server %s:%s rejected %d chunk(s), error %" PRIu64 "\n",
+            conn->server->ip, conn->server->port, frame->count,
+            GetU64(payload));
+    return -1;
+  }
+
+  for (int i = 0; i < frame->count; i++) {
+    struct Chunk *chunk = &sched->chunks[frame->chunks[i]];
+    chunk->result = GetU64(payload + i * FRAME_RESULT_SIZE);
+    chunk->state = CHUNK_DONE;
+    chunk->owner = NULL;
+    conn->numbers_done += chunk->end - chunk->begin + 1;
+  }
+  sched->done += frame->count;
+  conn->in_flight -= frame->count;
+  conn->chunks_done += frame->count;
+  conn->finished_ms = NowMs();
+  frame->used = false;
+  return 0;
+}
+
+// Handles every complete frame at the start of the input buffer and keeps
+// the incomplete rest. Returns -1 on a malformed or unexpected frame.
+static int HandleInput(struct Scheduler *sched, struct Connection *conn) {
+  size_t offset = 0;
+  while (true) {
+    struct FrameHeader header;
+    int decoded = DecodeHeader(conn->in + offset, conn->in_len - offset,
+                               &header);
+    if (decoded == 0)
+      break;
+    size_t size = FRAME_HEADER_SIZE + FramePayloadSize(&header);
+    if (decoded < 0 || header.type == FRAME_REQUEST ||
+        size > sizeof(conn->in)) {
+      fprintf(stderr, "Server %s:%s sent a malformed frame\n",
+              conn->server->ip, conn->server->port);
+      return -1;
+    }
+    if (conn->in_len - offset < size)
+      break;
+    if (HandleResponse(sched, conn, &header,
+                       conn->in + offset + FRAME_HEADER_SIZE) < 0)
+      return -1;
+    offset += size;
+  }
+  memmove(conn->in, conn->in + offset, conn->in_len - offset);
+  conn->in_len -= offset;
+  return 0;
+}
+
+// Advances the connection as far as the socket allows.
+// Returns -1 if the connection is broken.
+static int StepConnection(struct Scheduler *sched, struct Connection *conn) {
+  if (!conn->connected) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 ||
+        error != 0) {
+      fprintf(stderr, "Connection to %s:%s failed: %s\n", conn->server->ip,
+              conn->server->port, strerror(error));
+      return -1;
+    }
+    conn->connected = true;
+  }
+
+  while (true) {
+    ssize_t n = recv(conn->fd, conn->in + conn->in_len,
+                     sizeof(conn->in) - conn->in_len, 0);
+    if (n == 0) {
+      fprintf(stderr, "Server %s:%s closed the connection\n", conn->server->ip,
+              conn->server->port);
+      return -1;
+    }
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      fprintf(stderr, "Recieve failed\n");
+      return -1;
+    }
+    conn->in_len += n;
+    if (HandleInput(sched, conn) < 0)
+      return -1;
+  }
+
+  FillPipeline(sched, conn);
+  while (conn->out_sent < conn->out_len) {
+    ssize_t n = send(conn->fd, conn->out + conn->out_sent,
+                     conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      fprintf(stderr, "Send failed\n");
+      return -1;
+    }
+    conn->out_sent += n;
+  }
+  if (conn->out_sent == conn->out_len)
+    conn->out_len = conn->out_sent = 0;
+
+  WatchConnection(sched, conn);
+  return 0;
+}
+
 int main(int argc, char **argv) {
   uint64_t k = -1;
   uint64_t mod = -1;
-  char servers[255] = {'\0'}; // TODO: explain why 255
+  const char *servers = NULL; // path to the servers file
+  uint64_t chunk_size = 0;    // 0: about 32 chunks per server
+  int depth = 2;              // chunks in flight per unit of capacity
 
   while (true) {
     int current_optind = optind ? optind : 1;
@@ -56,6 +440,8 @@ int main(int argc, char **argv) {
     static struct option options[] = {{"k", required_argument, 0, 0},
                                       {"mod", required_argument, 0, 0},
                                       {"servers", required_argument, 0, 0},
+                                      {"chunk", required_argument, 0, 0},
+                                      {"depth", required_argument, 0, 0},
                                       {0, 0, 0, 0}};
 
     int option_index = 0;
@@ -68,16 +454,32 @@ int main(int argc, char **argv) {
     case 0: {
       switch (option_index) {
       case 0:
-        ConvertStringToUI64(optarg, &k);
-        // TODO: your code here
+        if (!ConvertStringToUI64(optarg, &k) || k == 0) {
+          fprintf(stderr, "k must be a positive number\n");
+          return 1;
+        }
         break;
       case 1:
-        ConvertStringToUI64(optarg, &mod);
-        // TODO: your code here
+        if (!ConvertStringToUI64(optarg, &mod) || mod == 0) {
+          fprintf(stderr, "mod must be a positive number\n");
+          return 1;
+        }
         break;
       case 2:
-        // TODO: your code here
-        memcpy(servers, optarg, strlen(optarg));
+        servers = optarg;
+        break;
+      case 3:
+        if (!ConvertStringToUI64(optarg, &chunk_size) || chunk_size == 0) {
+          fprintf(stderr, "chunk must be a positive number\n");
+          return 1;
+        }
+        break;
+      case 4:
+        depth = atoi(optarg);
+        if (depth <= 0) {
+          fprintf(stderr, "depth must be a positive number\n");
+          return 1;
+        }
         break;
       default:
         printf("Index %d is out of options\n", option_index);
@@ -92,73 +494,150 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (k == -1 || mod == -1 || !strlen(servers)) {
-    fprintf(stderr, "Using: %s --k 1000 --mod 5 --servers /path/to/file\n",
+  if (k == (uint64_t)-1 || mod == (uint64_t)-1 || servers == NULL) {
+    fprintf(stderr,
+            "Using: %s --k 1000 --mod 5 --servers /path/to/file "
+            "[--chunk N] [--depth 2]\n",
             argv[0]);
     return 1;
   }
 
-  // TODO: for one server here, rewrite with servers from file
-  unsigned int servers_num = 1;
-  struct Server *to = malloc(sizeof(struct Server) * servers_num);
-  // TODO: delete this and parallel work between servers
-  to[0].port = 20001;
-  memcpy(to[0].ip, "127.0.0.1", sizeof("127.0.0.1"));
-
-  // TODO: work continiously, rewrite to make parallel
-  for (int i = 0; i < servers_num; i++) {
-    struct hostent *hostname = gethostbyname(to[i].ip);
-    if (hostname == NULL) {
-      fprintf(stderr, "gethostbyname failed with %s\n", to[i].ip);
-      exit(1);
-    }
+  // The plan gives 0 for k >= mod and may replace [1, k] with a shorter
+  // Wilson complement for a prime mod; the servers see plain ranges
+  struct FactorialArgs whole = {1, k, mod};
+  struct FactorialPlan plan;
+  PlanFactorial(&whole, &plan);
+  if (plan.kind == FACTORIAL_ZERO) {
+    printf("answer: 0\n");
+    return 0;
+  }
 
-    struct sockaddr_in server;
-    server.sin_family = AF_INET;
-    server.sin_port = htons(to[i].port);
-    server.sin_addr.s_addr = *((unsigned long *)hostname->h_addr);
+  unsigned int servers_num = 0;
+  struct Server *to = ReadServers(servers, &servers_num);
+  if (servers_num == 0) {
+    fprintf(stderr, "No servers in %s\n", servers);
+    FreeServers(to, servers_num);
+    return 1;
+  }
 
-    int sck = socket(AF_INET, SOCK_STREAM, 0);
-    if (sck < 0) {
-      fprintf(stderr, "Socket creation failed!\n");
-      exit(1);
-    }
+  uint64_t total = 0;
+  for (int r = 0; r < plan.ranges_num; r++) {
+    if (plan.ranges[r].begin <= plan.ranges[r].end)
+      total += plan.ranges[r].end - plan.ranges[r].begin + 1;
+  }
+  if (chunk_size == 0) {
+    chunk_size = total / (servers_num * 32);
+    if (chunk_size == 0)
+      chunk_size = 1;
+  }
 
-    if (connect(sck, (struct sockaddr *)&server, sizeof(server)) < 0) {
-      fprintf(stderr, "Connection failed\n");
-      exit(1);
+  struct Scheduler sched = {0};
+  sched.mod = mod;
+  sched.chunks_num = 0;
+  for (int r = 0; r < plan.ranges_num; r++) {
+    const struct FactorialArgs *range = &plan.ranges[r];
+    if (range->begin <= range->end)
+      sched.chunks_num += (range->end - range->begin) / chunk_size + 1;
+  }
+  sched.chunks = calloc(sched.chunks_num ? sched.chunks_num : 1,
+                        sizeof(struct Chunk));
+  sched.pending = calloc(sched.chunks_num ? sched.chunks_num : 1,
+                         sizeof(uint64_t));
+  uint64_t next = 0;
+  for (int r = 0; r < plan.ranges_num; r++) {
+    const struct FactorialArgs *range = &plan.ranges[r];
+    if (range->begin > range->end)
+      continue;
+    for (uint64_t begin = range->begin;; begin += chunk_size) {
+      struct Chunk *chunk = &sched.chunks[next++];
+      chunk->begin = begin;
+      chunk->end = range->end - begin < chunk_size ? range->end
+                                                    : begin + chunk_size - 1;
+      if (chunk->end == range->end)
+        break;
     }
+  }
+  // Pending is a stack: push in reverse so chunks go out from the start
+  for (uint64_t i = 0; i < sched.chunks_num; i++)
+    sched.pending[i] = sched.chunks_num - 1 - i;
+  sched.pending_num = sched.chunks_num;
 
-    // TODO: for one server
-    // parallel between servers
-    uint64_t begin = 1;
-    uint64_t end = k;
-
-    char task[sizeof(uint64_t) * 3];
-    memcpy(task, &begin, sizeof(uint64_t));
-    memcpy(task + sizeof(uint64_t), &end, sizeof(uint64_t));
-    memcpy(task + 2 * sizeof(uint64_t), &mod, sizeof(uint64_t));
+  sched.epoll_fd = epoll_create1(0);
+  if (sched.epoll_fd < 0) {
+    perror("epoll_create1");
+    return 1;
+  }
 
-    if (send(sck, task, sizeof(task), 0) < 0) {
-      fprintf(stderr, "Send failed\n");
-      exit(1);
+  double start_ms = NowMs();
+  struct Connection *conns = calloc(servers_num, sizeof(struct Connection));
+  unsigned int alive = 0;
+  for (unsigned int i = 0; i < servers_num; i++) {
+    struct Connection *conn = &conns[i];
+    conn->server = &to[i];
+    conn->fd = -1;
+    uint64_t conn_depth = (uint64_t)depth * to[i].capacity;
+    conn->depth = conn_depth > MAX_DEPTH ? MAX_DEPTH : (int)conn_depth;
+    if (StartConnect(conn) < 0) {
+      conn->dead = true;
+      continue;
     }
+    struct epoll_event event = {.events = EPOLLOUT, .data.ptr = conn};
+    epoll_ctl(sched.epoll_fd, EPOLL_CTL_ADD, conn->fd, &event);
+    alive++;
+  }
 
-    char response[sizeof(uint64_t)];
-    if (recv(sck, response, sizeof(response), 0) < 0) {
-      fprintf(stderr, "Recieve failed\n");
+  while (sched.done < sched.chunks_num && alive > 0) {
+    struct epoll_event events[64];
+    int ready = epoll_wait(sched.epoll_fd, events, 64, -1);
+    if (ready < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait");
       exit(1);
     }
+    for (int e = 0; e < ready; e++) {
+      struct Connection *conn = events[e].data.ptr;
+      if (conn->dead)
+        continue; // dropped earlier in this batch
+      if (StepConnection(&sched, conn) < 0) {
+        DropConnection(&sched, conn, conns, servers_num);
+        alive--;
+      }
+    }
+  }
+  double total_ms = NowMs() - start_ms;
 
-    // TODO: from one server
-    // unite results
-    uint64_t answer = 0;
-    memcpy(&answer, response, sizeof(uint64_t));
-    printf("answer: %llu\n", answer);
+  if (sched.done < sched.chunks_num) {
+    fprintf(stderr, "All servers failed, %" PRIu64 " of %" PRIu64
+                    " chunks left\n",
+            sched.chunks_num - sched.done, sched.chunks_num);
+    return 1;
+  }
 
-    close(sck);
+  uint64_t product = 1 % mod;
+  for (uint64_t i = 0; i < sched.chunks_num; i++)
+    product = MultModulo(product, sched.chunks[i].result, mod);
+  uint64_t answer = FinishFactorial(&plan, product);
+
+  for (unsigned int i = 0; i < servers_num; i++) {
+    struct Connection *conn = &conns[i];
+    double busy_ms = conn->chunks_done ? conn->finished_ms - start_ms : 0;
+    printf("%s:%s %" PRIu64 " chunks, %" PRIu64 " numbers, %.2f Mnum/s%s\n",
+           to[i].ip, to[i].port, conn->chunks_done, conn->numbers_done,
+           busy_ms > 0 ? conn->numbers_done / busy_ms / 1e3 : 0.0,
+           conn->dead ? " (dropped)" : "");
+    if (conn->fd >= 0)
+      close(conn->fd);
   }
-  free(to);
+  printf("answer: %" PRIu64 "\n", answer);
+  printf("%" PRIu64 " chunks of %" PRIu64 ", elapsed time: %.2f ms\n",
+         sched.chunks_num, chunk_size, total_ms);
+
+  close(sched.epoll_fd);
+  free(sched.chunks);
+  free(sched.pending);
+  free(conns);
+  FreeServers(to, servers_num);
 
   return 0;
 }
@@ -0,0 +1,234 @@
+#include "factorial.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "multmodulo.h"
+
+_Static_assert(sizeof(void *) >= sizeof(uint64_t),
+               "ThreadFactorial returns uint64_t through void *");
+
+// The loops below keep four independent products (a product tree of
+// width 4 over i, i + 1, i + 2, i + 3) so consecutive multiplications do
+// not wait for each other's latency; the leaves are combined at the end.
+#define LANES 4
+
+static uint64_t FactorialMontgomery(const struct Montgomery *m, uint64_t begin,
+                                    uint64_t end) {
+  // Multiplying by i in normal form drops one factor of R per step:
+  // after k steps ans = product * R^-k, fixed up once at the end. That is
+  // one Montgomery multiplication per element instead of two.
+  uint64_t acc[LANES] = {1, 1, 1, 1};
+  uint64_t steps = 0;
+  uint64_t i = begin;
+  while (end - i >= LANES - 1) {
+    for (int lane = 0; lane < LANES; lane++)
+      acc[lane] = MontgomeryMult(m, acc[lane], i + lane);
+    steps += LANES;
+    i += LANES;
+    if (i - 1 == end)
+      break;
+  }
+  if (i - 1 != end) {
+    for (;; i++) {
+      acc[0] = MontgomeryMult(m, acc[0], i);
+      steps++;
+      if (i == end)
+        break;
+    }
+  }
+
+  uint64_t ans = MontgomeryMult(m, MontgomeryMult(m, acc[0], acc[1]),
+                                MontgomeryMult(m, acc[2], acc[3]));
+  steps += LANES - 1;
+  return MultModulo(ans, PowModulo(m->r, steps, m->mod), m->mod);
+}
+
+static uint64_t FactorialSmall(uint64_t begin, uint64_t end, uint64_t mod) {
+  uint64_t acc[LANES] = {1 % mod, 1 % mod, 1 % mod, 1 % mod};
+  uint64_t i = begin;
+  while (end - i >= LANES - 1) {
+    for (int lane = 0; lane < LANES; lane++)
+      acc[lane] = acc[lane] * ((i + lane) % mod) % mod;
+    i += LANES;
+    if (i - 1 == end)
+      break;
+  }
+  if (i - 1 != end) {
+    for (;; i++) {
+      acc[0] = acc[0] * (i % mod) % mod;
+      if (i == end)
+        break;
+    }
+  }
+  return (acc[0] * acc[1] % mod) * (acc[2] * acc[3] % mod) % mod;
+}
+
+static uint64_t FactorialWide(uint64_t begin, uint64_t end, uint64_t mod) {
+  uint64_t acc[LANES] = {1, 1, 1, 1};
+  uint64_t i = begin;
+  while (end - i >= LANES - 1) {
+    for (int lane = 0; lane < LANES; lane++)
+      acc[lane] = MultModulo(acc[lane], i + lane, mod);
+    i += LANES;
+    if (i - 1 == end)
+      break;
+  }
+  if (i - 1 != end) {
+    for (;; i++) {
+      acc[0] = MultModulo(acc[0], i, mod);
+      if (i == end)
+        break;
+    }
+  }
+  return MultModulo(MultModulo(acc[0], acc[1], mod),
+                    MultModulo(acc[2], acc[3], mod), mod);
+}
+
+// Plain product over [begin, end], no shortcuts
+static uint64_t RangeProduct(const struct FactorialArgs *args) {
+  uint64_t mod = args->mod;
+  if (args->begin > args->end || mod == 1)
+    return 1 % mod;
+
+  struct Montgomery m;
+  if (MontgomeryInit(&m, mod))
+    return FactorialMontgomery(&m, args->begin, args->end);
+  if (mod <= UINT32_MAX)
+    return FactorialSmall(args->begin, args->end, mod);
+  return FactorialWide(args->begin, args->end, mod);
+}
+
+void PlanFactorial(const struct FactorialArgs *args, struct FactorialPlan *plan) {
+  uint64_t mod = args->mod;
+  uint64_t begin = args->begin;
+  uint64_t end = args->end;
+  plan->mod = mod;
+  plan->kind = FACTORIAL_DIRECT;
+  plan->ranges_num = 1;
+  plan->ranges[0] = *args;
+  if (mod == 0 || begin > end)
+    return;
+
+  // A multiple of mod inside the range
+  if (begin == 0 || end / mod != (begin - 1) / mod) {
+    plan->kind = FACTORIAL_ZERO;
+    plan->ranges_num = 0;
+    return;
+  }
+
+  // Now the range lies inside one period: reduced, it is [lo, hi] with
+  // 1 <= lo <= hi <= mod - 1. Its complement in [1, mod - 1] is
+  // [1, lo - 1] and [hi + 1, mod - 1]. Checking primality only pays off
+  // when the complement is the shorter side.
+  uint64_t lo = begin % mod;
+  uint64_t hi = end % mod;
+  uint64_t length = hi - lo + 1;
+  uint64_t complement = (lo - 1) + (mod - 1 - hi);
+  if (complement >= length || !IsPrime(mod))
+    return;
+
+  plan->kind = FACTORIAL_WILSON;
+  plan->ranges_num = 2;
+  plan->ranges[0] = (struct FactorialArgs){1, lo - 1, mod};
+  plan->ranges[1] = (struct FactorialArgs){hi + 1, mod - 1, mod};
+}
+
+uint64_t FinishFactorial(const struct FactorialPlan *plan, uint64_t product) {
+  switch (plan->kind) {
+  case FACTORIAL_ZERO:
+    return 0;
+  case FACTORIAL_WILSON:
+    // product * answer == (p - 1)! == -1; product is not 0 as all its
+    // factors are below p
+    return plan->mod - PowModulo(product, plan->mod - 2, plan->mod);
+  default:
+    return product;
+  }
+}
+
+uint64_t Factorial(const struct FactorialArgs *args) {
+  uint64_t mod = args->mod;
+  if (mod == 0)
+    return 0;
+
+  struct FactorialPlan plan;
+  PlanFactorial(args, &plan);
+  uint64_t product = 1 % mod;
+  for (int i = 0; i < plan.ranges_num; i++)
+    product = MultModulo(product, RangeProduct(&plan.ranges[i]), mod);
+  return FinishFactorial(&plan, product);
+}
+
+static void *ThreadRangeProduct(void *args) {
+  return (void *)(uintptr_t)RangeProduct((struct FactorialArgs *)args);
+}
+
+uint64_t FactorialParallel(const struct FactorialArgs *args, int threads) {
+  uint64_t mod = args->mod;
+  if (mod == 0)
+    return 0;
+  if (threads < 1)
+    threads = 1;
+
+  struct FactorialPlan plan;
+  PlanFactorial(args, &plan);
+
+  // Every planned range gets its share of threads
+  int parts_num = threads * plan.ranges_num;
+  struct FactorialArgs parts[parts_num > 0 ? parts_num : 1];
+  for (int r = 0; r < plan.ranges_num; r++)
+    SplitFactorialRange(plan.ranges[r].begin, plan.ranges[r].end, mod,
+                        threads, parts + r * threads);
+
+  pthread_t tids[parts_num > 0 ? parts_num : 1];
+  uint64_t products[parts_num > 0 ? parts_num : 1];
+  bool started[parts_num > 0 ? parts_num : 1];
+  for (int i = 0; i < parts_num; i++) {
+    started[i] =
+        pthread_create(&tids[i], NULL, ThreadRangeProduct, &parts[i]) == 0;
+    if (!started[i])
+      products[i] = RangeProduct(&parts[i]);
+  }
+  for (int i = 0; i < parts_num; i++) {
+    if (started[i]) {
+      void *result = NULL;
+      pthread_join(tids[i], &result);
+      products[i] = (uint64_t)(uintptr_t)result;
+    }
+  }
+
+  // Balanced pairwise combination
+  for (int width = 1; width < parts_num; width *= 2) {
+    for (int i = 0; i + width < parts_num; i += 2 * width)
+      products[i] = MultModulo(products[i], products[i + width], mod);
+  }
+  return FinishFactorial(&plan, parts_num > 0 ? products[0] : 1 % mod);
+}
+
+void *ThreadFactorial(void *args) {
+  struct FactorialArgs *fargs = (struct FactorialArgs *)args;
+  return (void *)(uintptr_t)Factorial(fargs);
+}
+
+void SplitFactorialRange(uint64_t begin, uint64_t end, uint64_t mod,
+                         uint32_t parts, struct FactorialArgs *out) {
+  uint64_t length = begin <= end ? end - begin + 1 : 0;
+  uint64_t chunk = length / parts;
+  uint64_t extra = length % parts;
+  uint64_t next = begin;
+
+  for (uint32_t i = 0; i < parts; i++) {
+    // The first `extra` parts get one element more
+    uint64_t size = chunk + (i < extra ? 1 : 0);
+    out[i].mod = mod;
+    if (size == 0) {
+      out[i].begin = 1;
+      out[i].end = 0;
+      continue;
+    }
+    out[i].begin = next;
+    out[i].end = next + (size - 1);
+    next += size;
+  }
+}
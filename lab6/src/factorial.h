@@ -0,0 +1,53 @@
+#ifndef FACTORIAL_H
+#define FACTORIAL_H
+
+#include <stdint.h>
+
+struct FactorialArgs {
+  uint64_t begin;
+  uint64_t end;
+  uint64_t mod;
+};
+
+// Product of all integers in [begin, end] modulo mod (1 % mod if the range
+// is empty). Odd moduli use Montgomery multiplication, small moduli plain
+// 64-bit arithmetic, the rest a 128-bit product. Shortcuts of
+// PlanFactorial apply.
+uint64_t Factorial(const struct FactorialArgs *args);
+
+// Same result, with the planned ranges split across threads and the
+// per-thread products combined pairwise.
+uint64_t FactorialParallel(const struct FactorialArgs *args, int threads);
+
+// pthread entry point: the result is returned by value in the void *.
+void *ThreadFactorial(void *args);
+
+// Splits [begin, end] into parts contiguous subranges; the last ones are
+// empty if the range is shorter than parts.
+void SplitFactorialRange(uint64_t begin, uint64_t end, uint64_t mod,
+                         uint32_t parts, struct FactorialArgs *out);
+
+enum FactorialPlanKind {
+  FACTORIAL_ZERO,   // the range holds a multiple of mod: the answer is 0
+  FACTORIAL_DIRECT, // the answer is the product of ranges
+  FACTORIAL_WILSON, // prime mod: the answer is -1 / product of ranges
+};
+
+// How to get the product over args with as few multiplications as
+// possible. Any range containing a multiple of mod gives 0 (k! for
+// k >= mod in particular). For a prime mod p, a range covering most of a
+// period of p is replaced with its complement in [1, p - 1] through
+// Wilson's theorem, (p - 1)! == -1 (mod p). The ranges are multiplied by
+// the caller (possibly in parallel) and passed to FinishFactorial.
+struct FactorialPlan {
+  enum FactorialPlanKind kind;
+  uint64_t mod;
+  int ranges_num;
+  struct FactorialArgs ranges[2];
+};
+
+void PlanFactorial(const struct FactorialArgs *args, struct FactorialPlan *plan);
+
+uint64_t FinishFactorial(const struct FactorialPlan *plan, uint64_t product);
+
+#endif
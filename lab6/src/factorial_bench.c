@@ -0,0 +1,71 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "factorial.h"
+#include "multmodulo.h"
+
+// k! mod p for a prime p: the plain linear loop against the Factorial
+// engine (4-lane product tree, zero and Wilson shortcuts) and
+// FactorialParallel.
+// Usage: ./factorial_bench [p] [threads]
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t LinearLoop(uint64_t k, uint64_t mod) {
+  uint64_t ans = 1 % mod;
+  for (uint64_t i = 1; i <= k; i++)
+    ans = MultModulo(ans, i, mod);
+  return ans;
+}
+
+// Prints one table row; returns false if the three answers differ
+static bool RunCase(const char *name, uint64_t k, uint64_t p, int threads) {
+  struct FactorialArgs args = {1, k, p};
+
+  double start = NowSeconds();
+  uint64_t linear = LinearLoop(k, p);
+  double linear_s = NowSeconds() - start;
+
+  start = NowSeconds();
+  uint64_t engine = Factorial(&args);
+  double engine_s = NowSeconds() - start;
+
+  start = NowSeconds();
+  uint64_t parallel = FactorialParallel(&args, threads);
+  double parallel_s = NowSeconds() - start;
+
+  printf("%-14s k=%-12" PRIu64 " linear %9.3f ms  engine %9.3f ms (x%.1f)  "
+         "%d threads %9.3f ms (x%.1f)\n",
+         name, k, linear_s * 1e3, engine_s * 1e3, linear_s / engine_s, threads,
+         parallel_s * 1e3, linear_s / parallel_s);
+  if (linear != engine || linear != parallel) {
+    printf("MISMATCH: %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", linear, engine,
+           parallel);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint64_t p = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000007;
+  int threads = argc > 2 ? atoi(argv[2]) : 4;
+  if (!IsPrime(p) || p < 1000 || threads <= 0) {
+    fprintf(stderr, "Usage: %s [prime >= 1000] [threads]\n", argv[0]);
+    return 1;
+  }
+
+  bool ok = true;
+  ok &= RunCase("k = p / 3", p / 3, p, threads);
+  ok &= RunCase("k = p / 2", p / 2, p, threads);
+  ok &= RunCase("k = 3p / 4", p / 4 * 3, p, threads);
+  ok &= RunCase("k = p - 1000", p - 1000, p, threads);
+  ok &= RunCase("k = p + 1", p + 1, p, threads);
+  return ok ? 0 : 1;
+}
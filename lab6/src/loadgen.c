@@ -0,0 +1,345 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "factorial.h"
+#include "protocol.h"
+
+#define MAX_PIPELINE 64
+
+// Closed-loop load generator for the factorial server: every connection
+// keeps pipeline request frames of batch ranges in flight and sends a new
+// one as soon as an answer arrives.
+struct LoadArgs {
+  const char *host;
+  const char *port;
+  uint64_t k;
+  uint64_t mod;
+  uint64_t expected;
+  int pipeline;
+  int batch;
+  double duration_ms;
+  double *latencies; // microseconds
+  size_t count;
+  size_t allocated;
+  size_t errors;
+};
+
+static double NowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int Connect(const char *host, const char *port) {
+  struct addrinfo hints = {0};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *res = NULL;
+  if (getaddrinfo(host, port, &hints, &res) != 0)
+    return -1;
+
+  int fd = -1;
+  for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+
+  if (fd >= 0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+static bool SendAll(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    buf += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static bool RecvAll(int fd, char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = recv(fd, buf, len, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    buf += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static bool RecordLatency(struct LoadArgs *args, double latency_us) {
+  if (args->count == args->allocated) {
+    size_t allocated = args->allocated ? args->allocated * 2 : 4096;
+    double *latencies = realloc(args->latencies, allocated * sizeof(double));
+    if (latencies == NULL)
+      return false;
+    args->latencies = latencies;
+    args->allocated = allocated;
+  }
+  args->latencies[args->count++] = latency_us;
+  return true;
+}
+
+static void *LoadThread(void *arg) {
+  struct LoadArgs *args = (struct LoadArgs *)arg;
+  int fd = Connect(args->host, args->port);
+  if (fd < 0) {
+    args->errors++;
+    return NULL;
+  }
+
+  // Every frame asks for the same ranges, only the id changes
+  struct FactorialArgs ranges[args->batch];
+  for (int i = 0; i < args->batch; i++)
+    ranges[i] = (struct FactorialArgs){1, args->k, args->mod};
+  size_t request_size = FRAME_HEADER_SIZE + args->batch * FRAME_RANGE_SIZE;
+  size_t payload_size = args->batch * FRAME_RESULT_SIZE;
+  char *request = malloc(request_size);
+  char *payload = malloc(payload_size > FRAME_ERROR_SIZE ? payload_size
+                                                         : FRAME_ERROR_SIZE);
+  // Frames in flight occupy slots; the slot number is the low byte of the
+  // request id, so out-of-order answers find their send time
+  double sent_at[MAX_PIPELINE];
+  bool busy[MAX_PIPELINE] = {false};
+  int free_slots[MAX_PIPELINE];
+  for (int i = 0; i < args->pipeline; i++)
+    free_slots[i] = i;
+  int free_num = args->pipeline;
+
+  uint64_t next_id = 0;
+  int outstanding = 0;
+  double stop = NowMs() + args->duration_ms;
+  while (request != NULL && payload != NULL) {
+    double now = NowMs();
+    while (now < stop && free_num > 0) {
+      int slot = free_slots[--free_num];
+      EncodeRequest(request, next_id << 8 | slot, ranges,
+                    (uint16_t)args->batch);
+      if (!SendAll(fd, request, request_size))
+        goto failed;
+      sent_at[slot] = now;
+      busy[slot] = true;
+      next_id++;
+      outstanding++;
+    }
+    if (outstanding == 0)
+      break;
+
+    char header_buf[FRAME_HEADER_SIZE];
+    struct FrameHeader header;
+    if (!RecvAll(fd, header_buf, sizeof(header_buf)) ||
+        DecodeHeader(header_buf, sizeof(header_buf), &header) <= 0 ||
+        header.type == FRAME_REQUEST ||
+        !RecvAll(fd, payload, FramePayloadSize(&header)))
+      goto failed;
+    int slot = (int)(header.id & 0xff);
+    if (slot >= args->pipeline || !busy[slot])
+      goto failed;
+    busy[slot] = false;
+    free_slots[free_num++] = slot;
+    outstanding--;
+
+    if (header.type == FRAME_ERROR || header.count != args->batch) {
+      args->errors++;
+      continue;
+    }
+    for (int i = 0; i < args->batch; i++) {
+      if (GetU64(payload + i * FRAME_RESULT_SIZE) != args->expected)
+        args->errors++;
+    }
+    if (!RecordLatency(args,
+                       (NowMs() - sent_at[slot]) * 1000.0))
+      break;
+  }
+  goto done;
+
+failed:
+  args->errors++;
+done:
+  free(request);
+  free(payload);
+  close(fd);
+  return NULL;
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double Percentile(const double *sorted, size_t count, double p) {
+  if (count == 0)
+    return 0;
+  size_t index = (size_t)(p * (count - 1) + 0.5);
+  return sorted[index];
+}
+
+int main(int argc, char **argv) {
+  const char *host = "127.0.0.1";
+  const char *port = NULL;
+  int connections = 16;
+  int pipeline = 1;
+  int batch = 1;
+  double duration = 5;
+  uint64_t k = 1000;
+  uint64_t mod = 1000000007;
+
+  while (true) {
+    static struct option options[] = {{"host", required_argument, 0, 0},
+                                      {"port", required_argument, 0, 0},
+                                      {"connections", required_argument, 0, 0},
+                                      {"duration", required_argument, 0, 0},
+                                      {"k", required_argument, 0, 0},
+                                      {"mod", required_argument, 0, 0},
+                                      {"pipeline", required_argument, 0, 0},
+                                      {"batch", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 0:
+      switch (option_index) {
+      case 0:
+        host = optarg;
+        break;
+      case 1:
+        port = optarg;
+        break;
+      case 2:
+        connections = atoi(optarg);
+        break;
+      case 3:
+        duration = atof(optarg);
+        break;
+      case 4:
+        k = strtoull(optarg, NULL, 10);
+        break;
+      case 5:
+        mod = strtoull(optarg, NULL, 10);
+        break;
+      case 6:
+        pipeline = atoi(optarg);
+        break;
+      case 7:
+        batch = atoi(optarg);
+        break;
+      default:
+        printf("Index %d is out of options\n", option_index);
+      }
+      break;
+
+    case '?':
+      printf("Arguments error\n");
+      break;
+    default:
+      fprintf(stderr, "getopt returned character code 0%o?\n", c);
+    }
+  }
+
+  if (port == NULL || connections <= 0 || duration <= 0 || mod == 0 ||
+      pipeline <= 0 || pipeline > MAX_PIPELINE || batch <= 0 ||
+      batch > FRAME_MAX_COUNT) {
+    fprintf(stderr,
+            "Using: %s --port 20001 [--host 127.0.0.1] [--connections 16] "
+            "[--duration 5] [--k 1000] [--mod 1000000007] [--pipeline 1..%d] "
+            "[--batch 1..%d]\n",
+            argv[0], MAX_PIPELINE, FRAME_MAX_COUNT);
+    return 1;
+  }
+
+  struct FactorialArgs whole = {.begin = 1, .end = k, .mod = mod};
+  uint64_t expected = Factorial(&whole);
+
+  struct LoadArgs *args = calloc(connections, sizeof(struct LoadArgs));
+  pthread_t *threads = calloc(connections, sizeof(pthread_t));
+  if (args == NULL || threads == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+
+  double started = NowMs();
+  for (int i = 0; i < connections; i++) {
+    args[i].host = host;
+    args[i].port = port;
+    args[i].k = k;
+    args[i].mod = mod;
+    args[i].expected = expected;
+    args[i].pipeline = pipeline;
+    args[i].batch = batch;
+    args[i].duration_ms = duration * 1000.0;
+    if (pthread_create(&threads[i], NULL, LoadThread, &args[i])) {
+      fprintf(stderr, "Error: pthread_create failed!\n");
+      return 1;
+    }
+  }
+
+  size_t total = 0;
+  size_t errors = 0;
+  for (int i = 0; i < connections; i++) {
+    pthread_join(threads[i], NULL);
+    total += args[i].count;
+    errors += args[i].errors;
+  }
+  double elapsed_ms = NowMs() - started;
+
+  double *all = malloc((total ? total : 1) * sizeof(double));
+  size_t filled = 0;
+  for (int i = 0; i < connections; i++) {
+    memcpy(all + filled, args[i].latencies, args[i].count * sizeof(double));
+    filled += args[i].count;
+    free(args[i].latencies);
+  }
+  qsort(all, total, sizeof(double), CompareDoubles);
+
+  printf("connections: %d, pipeline: %d, batch: %d, k: %" PRIu64
+         ", mod: %" PRIu64 "\n",
+         connections, pipeline, batch, k, mod);
+  printf("frames: %zu in %.2f s, errors: %zu\n", total, elapsed_ms / 1000.0,
+         errors);
+  printf("throughput: %.0f req/s (%.0f ranges/s)\n",
+         total / (elapsed_ms / 1000.0), total * batch / (elapsed_ms / 1000.0));
+  printf("latency us: p50 %.1f, p99 %.1f, max %.1f\n",
+         Percentile(all, total, 0.50), Percentile(all, total, 0.99),
+         total ? all[total - 1] : 0.0);
+
+  free(all);
+  free(args);
+  free(threads);
+  return errors ? 1 : 0;
+}
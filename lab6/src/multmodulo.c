@@ -0,0 +1,83 @@
+#include "multmodulo.h"
+
+uint64_t MultModulo(uint64_t a, uint64_t b, uint64_t mod) {
+  if (mod <= UINT32_MAX) {
+    // Both factors are below 2^32 after reduction: 64 bits are enough
+    return ((a % mod) * (b % mod)) % mod;
+  }
+  return (uint64_t)(((unsigned __int128)a * b) % mod);
+}
+
+uint64_t MultModuloSlow(uint64_t a, uint64_t b, uint64_t mod) {
+  uint64_t result = 0;
+  a = a % mod;
+  while (b > 0) {
+    if (b % 2 == 1)
+      result = (result + a) % mod;
+    a = (a * 2) % mod;
+    b /= 2;
+  }
+
+  return result % mod;
+}
+
+uint64_t PowModulo(uint64_t base, uint64_t exp, uint64_t mod) {
+  uint64_t result = 1 % mod;
+  base %= mod;
+  while (exp > 0) {
+    if (exp & 1)
+      result = MultModulo(result, base, mod);
+    base = MultModulo(base, base, mod);
+    exp >>= 1;
+  }
+  return result;
+}
+
+bool IsPrime(uint64_t n) {
+  // The first 12 primes as bases are enough for n < 3.3 * 10^24
+  static const uint64_t bases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+  const int bases_num = sizeof(bases) / sizeof(bases[0]);
+  if (n < 2)
+    return false;
+  for (int i = 0; i < bases_num; i++) {
+    if (n % bases[i] == 0)
+      return n == bases[i];
+  }
+
+  uint64_t d = n - 1;
+  int s = 0;
+  while (d % 2 == 0) {
+    d /= 2;
+    s++;
+  }
+
+  for (int i = 0; i < bases_num; i++) {
+    uint64_t x = PowModulo(bases[i], d, n);
+    if (x == 1 || x == n - 1)
+      continue;
+    bool composite = true;
+    for (int r = 1; r < s && composite; r++) {
+      x = MultModulo(x, x, n);
+      composite = x != n - 1;
+    }
+    if (composite)
+      return false;
+  }
+  return true;
+}
+
+bool MontgomeryInit(struct Montgomery *m, uint64_t mod) {
+  if (mod < 3 || mod % 2 == 0)
+    return false;
+
+  // Newton iteration for mod^-1 mod 2^64: each step doubles the correct
+  // bits, and mod * mod == 1 (mod 8) gives the first three.
+  uint64_t inv = mod;
+  for (int i = 0; i < 5; i++)
+    inv *= 2 - mod * inv;
+
+  m->mod = mod;
+  m->inv = -inv;
+  m->r = (uint64_t)(((unsigned __int128)1 << 64) % mod);
+  return true;
+}
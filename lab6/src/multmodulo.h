@@ -0,0 +1,50 @@
+#ifndef MULTMODULO_H
+#define MULTMODULO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// (a * b) % mod without overflow, via a 128-bit product.
+uint64_t MultModulo(uint64_t a, uint64_t b, uint64_t mod);
+
+// The original add-and-double version: O(log b) additions. Kept as the
+// reference for tests and benchmarks.
+uint64_t MultModuloSlow(uint64_t a, uint64_t b, uint64_t mod);
+
+// (base ^ exp) % mod
+uint64_t PowModulo(uint64_t base, uint64_t exp, uint64_t mod);
+
+// Deterministic Miller-Rabin: exact for every 64-bit n.
+bool IsPrime(uint64_t n);
+
+// Montgomery arithmetic for an odd modulus, R = 2^64.
+// MontgomeryMult(a, b) returns a * b * R^-1 mod n for a * b < n * R.
+struct Montgomery {
+  uint64_t mod;
+  uint64_t inv;  // -mod^-1 mod 2^64
+  uint64_t r;    // R mod n
+};
+
+bool MontgomeryInit(struct Montgomery *m, uint64_t mod);
+
+static inline uint64_t MontgomeryReduce(const struct Montgomery *m,
+                                        unsigned __int128 t) {
+  uint64_t lo = (uint64_t)t;
+  uint64_t hi = (uint64_t)(t >> 64);
+  uint64_t q = lo * m->inv;
+  unsigned __int128 qn = (unsigned __int128)q * m->mod;
+  // lo + low64(qn) == 0 (mod 2^64): only the carry survives
+  uint64_t carry = lo != 0;
+  uint64_t result;
+  bool overflow =
+      __builtin_add_overflow(hi, (uint64_t)(qn >> 64) + carry, &result);
+  if (overflow || result >= m->mod) result -= m->mod;
+  return result;
+}
+
+static inline uint64_t MontgomeryMult(const struct Montgomery *m, uint64_t a,
+                                      uint64_t b) {
+  return MontgomeryReduce(m, (unsigned __int128)a * b);
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "factorial.h"
+#include "multmodulo.h"
+
+// Throughput of modular multiplication for 32-bit and 64-bit moduli:
+// the original add-and-double MultModulo, the 128-bit MultModulo and the
+// Montgomery-based Factorial engine.
+// Usage: ./multmodulo_bench [count]
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef uint64_t (*MultFunc)(uint64_t a, uint64_t b, uint64_t mod);
+
+static uint64_t LoopFactorial(MultFunc mult, uint64_t count, uint64_t mod) {
+  uint64_t ans = 1;
+  for (uint64_t i = 1; i <= count; i++)
+    ans = mult(ans, i, mod);
+  return ans;
+}
+
+static void Report(const char *name, uint64_t mod, uint64_t count,
+                   double seconds, uint64_t answer) {
+  printf("%-24s mod=%-20" PRIu64 " %8.2f Mmul/s  (%" PRIu64 ")\n", name, mod,
+         count / seconds / 1e6, answer);
+}
+
+static void RunBench(uint64_t mod, uint64_t count) {
+  double start = NowSeconds();
+  uint64_t slow = LoopFactorial(MultModuloSlow, count, mod);
+  Report("MultModuloSlow", mod, count, NowSeconds() - start, slow);
+
+  start = NowSeconds();
+  uint64_t fast = LoopFactorial(MultModulo, count, mod);
+  Report("MultModulo (128-bit)", mod, count, NowSeconds() - start, fast);
+
+  struct FactorialArgs args = {1, count, mod};
+  start = NowSeconds();
+  uint64_t engine = Factorial(&args);
+  Report("Factorial engine", mod, count, NowSeconds() - start, engine);
+
+  if (slow != fast || slow != engine)
+    printf("MISMATCH for mod %" PRIu64 "\n", mod);
+}
+
+int main(int argc, char **argv) {
+  uint64_t count = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+  if (count == 0) {
+    fprintf(stderr, "Usage: %s [count]\n", argv[0]);
+    return 1;
+  }
+
+  // Prime factors larger than count, so the products never collapse to
+  // zero. 64-bit moduli stay below 2^63: MultModuloSlow doubles a and
+  // overflows above that.
+  const uint64_t moduli[] = {
+      4294967291ULL,          // largest 32-bit prime
+      2 * 2147483647ULL,      // even 32-bit, 2 * (2^31 - 1)
+      4611686018427387847ULL, // 2^62 - 57, prime
+      2 * 2305843009213693951ULL, // even 64-bit, 2 * (2^61 - 1)
+  };
+
+  for (size_t i = 0; i < sizeof(moduli) / sizeof(moduli[0]); i++) {
+    RunBench(moduli[i], count);
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include "protocol.h"
+
+static void PutU32(char *buf, uint32_t value) {
+  buf[0] = (char)(value >> 24);
+  buf[1] = (char)(value >> 16);
+  buf[2] = (char)(value >> 8);
+  buf[3] = (char)value;
+}
+
+static uint32_t GetU32(const char *buf) {
+  const unsigned char *b = (const unsigned char *)buf;
+  return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8 |
+         b[3];
+}
+
+void EncodeHeader(char *buf, const struct FrameHeader *header) {
+  PutU32(buf, PROTO_MAGIC);
+  buf[4] = (char)header->version;
+  buf[5] = (char)header->type;
+  buf[6] = (char)(header->count >> 8);
+  buf[7] = (char)header->count;
+  PutU64(buf + 8, header->id);
+}
+
+int DecodeHeader(const char *buf, size_t len, struct FrameHeader *header) {
+  if (len < FRAME_HEADER_SIZE)
+    return 0;
+  if (GetU32(buf) != PROTO_MAGIC)
+    return -1;
+
+  header->version = (uint8_t)buf[4];
+  header->type = (uint8_t)buf[5];
+  header->count = (uint16_t)((unsigned char)buf[6] << 8 | (unsigned char)buf[7]);
+  header->id = GetU64(buf + 8);
+
+  if (header->version != PROTO_VERSION)
+    return -1;
+  switch (header->type) {
+  case FRAME_REQUEST:
+  case FRAME_RESPONSE:
+    if (header->count == 0 || header->count > FRAME_MAX_COUNT)
+      return -1;
+    break;
+  case FRAME_ERROR:
+    if (header->count != 0)
+      return -1;
+    break;
+  default:
+    return -1;
+  }
+  return 1;
+}
+
+size_t FramePayloadSize(const struct FrameHeader *header) {
+  switch (header->type) {
+  case FRAME_REQUEST:
+    return (size_t)header->count * FRAME_RANGE_SIZE;
+  case FRAME_RESPONSE:
+    return (size_t)header->count * FRAME_RESULT_SIZE;
+  default:
+    return FRAME_ERROR_SIZE;
+  }
+}
+
+size_t EncodeRequest(char *buf, uint64_t id, const struct FactorialArgs *ranges,
+                     uint16_t count) {
+  struct FrameHeader header = {PROTO_VERSION, FRAME_REQUEST, count, id};
+  EncodeHeader(buf, &header);
+  char *p = buf + FRAME_HEADER_SIZE;
+  for (uint16_t i = 0; i < count; i++, p += FRAME_RANGE_SIZE) {
+    PutU64(p, ranges[i].begin);
+    PutU64(p + 8, ranges[i].end);
+    PutU64(p + 16, ranges[i].mod);
+  }
+  return (size_t)(p - buf);
+}
+
+void DecodeRange(const char *buf, struct FactorialArgs *range) {
+  range->begin = GetU64(buf);
+  range->end = GetU64(buf + 8);
+  range->mod = GetU64(buf + 16);
+}
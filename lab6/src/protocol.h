@@ -0,0 +1,70 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "factorial.h"
+
+// Wire format of the factorial service. Every message is a frame:
+//
+//   u32 magic | u8 version | u8 type | u16 count | u64 request_id | payload
+//
+// All integers are big-endian. A request frame carries count ranges of
+// 24 bytes (begin, end, mod), the response to it carries count 8-byte
+// results in the same order and the same request_id. An error frame has
+// count 0 and an 8-byte error code. Requests on one connection may be
+// pipelined; responses can come back in any order and are matched by id.
+#define PROTO_MAGIC 0x46414354u // "FACT"
+#define PROTO_VERSION 1
+
+#define FRAME_HEADER_SIZE 16
+#define FRAME_RANGE_SIZE 24
+#define FRAME_RESULT_SIZE 8
+#define FRAME_ERROR_SIZE 8
+#define FRAME_MAX_COUNT 4096
+
+enum FrameType { FRAME_REQUEST = 1, FRAME_RESPONSE = 2, FRAME_ERROR = 3 };
+
+enum ProtoError { PROTO_ERR_ZERO_MOD = 1, PROTO_ERR_BUSY = 2 };
+
+struct FrameHeader {
+  uint8_t version;
+  uint8_t type;
+  uint16_t count;
+  uint64_t id;
+};
+
+static inline void PutU64(char *buf, uint64_t value) {
+  for (int i = 7; i >= 0; i--) {
+    buf[i] = (char)(value & 0xff);
+    value >>= 8;
+  }
+}
+
+static inline uint64_t GetU64(const char *buf) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++)
+    value = (value << 8) | (unsigned char)buf[i];
+  return value;
+}
+
+void EncodeHeader(char *buf, const struct FrameHeader *header);
+
+// Returns 1 if a valid header was decoded, 0 if fewer than
+// FRAME_HEADER_SIZE bytes are available, -1 if the bytes are not a frame
+// this version understands (bad magic, version, type or count).
+int DecodeHeader(const char *buf, size_t len, struct FrameHeader *header);
+
+// Size of the payload that follows the header.
+size_t FramePayloadSize(const struct FrameHeader *header);
+
+// Writes a complete request frame (header + ranges) into buf, which must
+// hold FRAME_HEADER_SIZE + count * FRAME_RANGE_SIZE bytes. Returns its size.
+size_t EncodeRequest(char *buf, uint64_t id, const struct FactorialArgs *ranges,
+                     uint16_t count);
+
+void DecodeRange(const char *buf, struct FactorialArgs *range);
+
+#endif
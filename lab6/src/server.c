@@ -1,4 +1,9 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdatomic.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,52 +13,575 @@
 #include <getopt.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
 #include "pthread.h"
 
-struct FactorialArgs {
-  uint64_t begin;
-  uint64_t end;
-  uint64_t mod;
+#include "cache.h"
+#include "factorial.h"
+#include "multmodulo.h"
+#include "protocol.h"
+#include "trace.h"
+#include "worker_pool.h"
+
+#define MAX_EVENTS 256
+// Ranges shorter than this per task are not worth a separate task
+#define MIN_TASK_RANGE 1024
+#define QUEUE_PER_THREAD 64
+// Per connection: frames in the pool and bytes waiting to be sent before
+// the reactor stops reading from it
+#define MAX_PIPELINE 64
+#define MAX_PENDING_OUTPUT (1 << 20)
+#define INPUT_BUFFER_SIZE 4096
+
+struct Connection;
+
+struct Request;
+
+// Part of one range of a request, computed by one pool thread
+struct RangeTask {
+  struct Request *req;
+  struct FactorialArgs args;
+  int range;
+  uint64_t result;
 };
 
-uint64_t MultModulo(uint64_t a, uint64_t b, uint64_t mod) {
-  uint64_t result = 0;
-  a = a % mod;
-  while (b > 0) {
-    if (b % 2 == 1)
-      result = (result + a) % mod;
-    a = (a * 2) % mod;
-    b /= 2;
+// One request frame on its way reactor -> pool -> reactor. Every range is
+// planned (PlanFactorial) and the planned ranges are split into range
+// tasks; the task that brings remaining to zero combines the partial
+// products and posts the request back.
+struct Request {
+  struct Connection *conn;
+  uint64_t id;
+  int count;
+  uint64_t *results;           // count entries, stored after tasks
+  struct FactorialPlan *plans; // count entries, stored after results
+  struct Request *next;
+  atomic_int remaining;
+  int submitted; // tasks handed to the pool so far
+  int tasks_num;
+  struct RangeTask tasks[];
+};
+
+// Per-connection state, touched only by the reactor thread. Frames are
+// parsed out of the input buffer as soon as they are complete, so a
+// client may pipeline up to MAX_PIPELINE of them; responses are appended
+// to the output buffer in completion order. A request whose tasks do not
+// all fit into the pool queue parks the connection on the waiting list;
+// it is not read again until the rest of the tasks is queued.
+struct Connection {
+  int fd;
+  char *in;
+  size_t in_len;
+  size_t in_cap;
+  char *out;
+  size_t out_len;
+  size_t out_sent;
+  size_t out_cap;
+  int in_flight;
+  bool closed; // peer is gone, free once in-flight requests return
+  struct Connection *next_dead;
+  struct Request *unqueued; // request with tasks still outside the pool
+  struct Connection *next_waiting;
+};
+
+// Finished requests posted by the pool; the eventfd wakes the reactor
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct Request *done_head = NULL;
+static int done_fd = -1;
+// Set by the reactor when the pool queue is full; the next pool thread to
+// take a task clears it and wakes the reactor to submit the rest
+static atomic_bool queue_full = false;
+
+// Connections with an unqueued request, in the order they stalled
+static struct Connection *waiting_head = NULL;
+static struct Connection *waiting_tail = NULL;
+
+// Closed connections are freed only after the whole epoll batch is handled:
+// a later event of the same batch may still point at them
+static struct Connection *dead_head = NULL;
+
+static bool verbose = false;
+static int split = 1; // --tnum, upper bound of tasks per range
+static struct FactorialCache *cache = NULL;
+
+static void WakeReactor(void) {
+  uint64_t one = 1;
+  if (write(done_fd, &one, sizeof(one)) < 0)
+    fprintf(stderr, "eventfd write failed\n");
+}
+
+// Combines the task products and posts req to the reactor
+static void CompleteRequest(struct Request *req) {
+  struct TraceSpan combine = TraceBegin("combine");
+  for (int i = 0; i < req->count; i++)
+    req->results[i] = 1 % req->plans[i].mod;
+  for (int i = 0; i < req->tasks_num; i++) {
+    struct RangeTask *t = &req->tasks[i];
+    req->results[t->range] =
+        MultModulo(req->results[t->range], t->result, t->args.mod);
+  }
+  for (int i = 0; i < req->count; i++)
+    req->results[i] = FinishFactorial(&req->plans[i], req->results[i]);
+  TraceEndArg(combine, req->tasks_num);
+
+  pthread_mutex_lock(&done_mutex);
+  req->next = done_head;
+  done_head = req;
+  pthread_mutex_unlock(&done_mutex);
+  WakeReactor();
+}
+
+static void ComputeRangeTask(void *arg) {
+  // The pool knows nothing about tracing, so its threads name their
+  // tracks on their first task
+  static _Thread_local bool named = false;
+  static atomic_int workers_named = 0;
+  if (!named && TraceEnabled()) {
+    char name[32];
+    snprintf(name, sizeof(name), "pool worker %d",
+             atomic_fetch_add(&workers_named, 1));
+    TraceSetThreadName(name);
+    named = true;
+  }
+
+  // Taking this task freed a queue slot
+  if (atomic_exchange(&queue_full, false))
+    WakeReactor();
+
+  struct RangeTask *task = (struct RangeTask *)arg;
+  struct TraceSpan compute = TraceBegin("range task");
+  task->result = CachedFactorial(cache, &task->args);
+  TraceEndArg(compute, (int64_t)(task->args.end - task->args.begin));
+
+  struct Request *req = task->req;
+  if (atomic_fetch_sub_explicit(&req->remaining, 1, memory_order_acq_rel) == 1)
+    CompleteRequest(req);
+}
+
+static void CloseConnection(struct Connection *conn) {
+  if (conn->fd >= 0) {
+    close(conn->fd); // also drops it from the epoll set
+    conn->fd = -1;
+  }
+  conn->closed = true;
+  if (conn->in_flight == 0) {
+    conn->next_dead = dead_head;
+    dead_head = conn;
+  }
+}
+
+static void FreeDeadConnections(void) {
+  while (dead_head) {
+    struct Connection *next = dead_head->next_dead;
+    free(dead_head->in);
+    free(dead_head->out);
+    free(dead_head);
+    dead_head = next;
+  }
+}
+
+// Returns a pointer to len free bytes at the end of the output buffer
+static char *ReserveOutput(struct Connection *conn, size_t len) {
+  if (conn->out_len + len > conn->out_cap) {
+    size_t cap = conn->out_cap ? conn->out_cap : INPUT_BUFFER_SIZE;
+    while (cap < conn->out_len + len)
+      cap *= 2;
+    char *out = realloc(conn->out, cap);
+    if (!out)
+      return NULL;
+    conn->out = out;
+    conn->out_cap = cap;
+  }
+  char *at = conn->out + conn->out_len;
+  conn->out_len += len;
+  return at;
+}
+
+static bool SendError(struct Connection *conn, uint64_t id, uint64_t code) {
+  char *at = ReserveOutput(conn, FRAME_HEADER_SIZE + FRAME_ERROR_SIZE);
+  if (!at)
+    return false;
+  struct FrameHeader header = {PROTO_VERSION, FRAME_ERROR, 0, id};
+  EncodeHeader(at, &header);
+  PutU64(at + FRAME_HEADER_SIZE, code);
+  return true;
+}
+
+// Sends what is left of the output. Returns false if the connection
+// broke; EAGAIN just leaves the rest for the next EPOLLOUT.
+static bool FlushOutput(struct Connection *conn) {
+  while (conn->out_sent < conn->out_len) {
+    ssize_t n = send(conn->fd, conn->out + conn->out_sent,
+                     conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    conn->out_sent += (size_t)n;
+  }
+  conn->out_len = conn->out_sent = 0;
+  return true;
+}
+
+// Moves the boundaries between parts back to block boundaries where that
+// keeps every part non-empty, so blocks are not cut in two and every part
+// can be served from the cache.
+static void AlignToCacheBlocks(struct FactorialArgs *parts, int count) {
+  for (int j = 0; j + 1 < count; j++) {
+    uint64_t end = parts[j].end;
+    uint64_t aligned = end - end % FACTORIAL_CACHE_BLOCK;
+    if (parts[j].begin > end || parts[j + 1].begin > parts[j + 1].end ||
+        aligned < parts[j].begin)
+      continue;
+    parts[j].end = aligned;
+    parts[j + 1].begin = aligned + 1;
+  }
+}
+
+static void PrintCacheStats(void) {
+  if (!cache) {
+    printf("Cache disabled\n");
+  } else {
+    struct FactorialCacheStats stats;
+    FactorialCacheGetStats(cache, &stats);
+    uint64_t lookups = stats.hits + stats.misses;
+    printf("Cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate), %" PRIu64
+           " evictions, %zu blocks, %.1f MiB\n",
+           stats.hits, stats.misses,
+           lookups ? 100.0 * stats.hits / lookups : 0.0, stats.evictions,
+           stats.entries, stats.bytes / (1024.0 * 1024.0));
+  }
+  fflush(stdout);
+}
+
+// Number of tasks for one planned range; empty ranges need none
+static int TaskCount(const struct FactorialArgs *range) {
+  if (range->begin > range->end)
+    return 0;
+  uint64_t length = range->end - range->begin + 1;
+  uint64_t n = (length - 1) / MIN_TASK_RANGE + 1;
+  return n > (uint64_t)split ? split : (int)n;
+}
+
+static struct Request *NewRequest(struct Connection *conn, uint64_t id,
+                                  const struct FactorialArgs *ranges,
+                                  int count) {
+  struct FactorialPlan plans[count];
+  int tasks_num = 0;
+  for (int i = 0; i < count; i++) {
+    PlanFactorial(&ranges[i], &plans[i]);
+    for (int r = 0; r < plans[i].ranges_num; r++)
+      tasks_num += TaskCount(&plans[i].ranges[r]);
+  }
+
+  struct Request *req =
+      malloc(sizeof(struct Request) + tasks_num * sizeof(struct RangeTask) +
+             count * (sizeof(uint64_t) + sizeof(struct FactorialPlan)));
+  if (!req)
+    return NULL;
+  req->conn = conn;
+  req->id = id;
+  req->count = count;
+  req->results = (uint64_t *)&req->tasks[tasks_num];
+  req->plans = (struct FactorialPlan *)&req->results[count];
+  req->submitted = 0;
+  req->tasks_num = tasks_num;
+  atomic_init(&req->remaining, tasks_num);
+
+  struct RangeTask *task = req->tasks;
+  for (int i = 0; i < count; i++) {
+    req->plans[i] = plans[i];
+    for (int r = 0; r < plans[i].ranges_num; r++) {
+      const struct FactorialArgs *range = &plans[i].ranges[r];
+      int parts = TaskCount(range);
+      if (parts == 0)
+        continue;
+      struct FactorialArgs sub[parts];
+      SplitFactorialRange(range->begin, range->end, range->mod, parts, sub);
+      if (cache)
+        AlignToCacheBlocks(sub, parts);
+      for (int j = 0; j < parts; j++, task++) {
+        task->req = req;
+        task->args = sub[j];
+        task->range = i;
+      }
+    }
+  }
+  return req;
+}
+
+// Hands the next task of req to the pool. Returns false if the queue is
+// full; a pool thread then wakes the reactor once it frees a slot.
+static bool SubmitNextTask(struct Request *req, struct WorkerPool *pool) {
+  struct RangeTask *task = &req->tasks[req->submitted];
+  if (!WorkerPoolTrySubmit(pool, ComputeRangeTask, task)) {
+    // A task taken before the flag is set sends no wakeup, so try once
+    // more after setting it
+    atomic_store(&queue_full, true);
+    if (!WorkerPoolTrySubmit(pool, ComputeRangeTask, task))
+      return false;
+  }
+  req->submitted++;
+  return true;
+}
+
+static void AddWaiting(struct Connection *conn) {
+  conn->next_waiting = NULL;
+  if (waiting_tail)
+    waiting_tail->next_waiting = conn;
+  else
+    waiting_head = conn;
+  waiting_tail = conn;
+}
+
+// Handles one complete request frame. Returns false if the connection has
+// to be dropped.
+static bool HandleRequest(struct Connection *conn, struct WorkerPool *pool,
+                          const struct FrameHeader *header,
+                          const char *payload) {
+  struct TraceSpan decode = TraceBegin("decode request");
+  struct FactorialArgs ranges[header->count];
+  bool zero_mod = false;
+  for (int i = 0; i < header->count; i++) {
+    DecodeRange(payload + i * FRAME_RANGE_SIZE, &ranges[i]);
+    if (verbose)
+      printf("Receive: %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", ranges[i].begin,
+             ranges[i].end, ranges[i].mod);
+    zero_mod |= ranges[i].mod == 0;
+  }
+  TraceEndArg(decode, header->count);
+  if (zero_mod)
+    return SendError(conn, header->id, PROTO_ERR_ZERO_MOD);
+
+  struct Request *req = NewRequest(conn, header->id, ranges, header->count);
+  if (!req)
+    return SendError(conn, header->id, PROTO_ERR_BUSY);
+  conn->in_flight++;
+  // Every range was answered by its plan alone (e.g. k >= mod)
+  if (req->tasks_num == 0)
+    CompleteRequest(req);
+  while (req->submitted < req->tasks_num) {
+    if (!SubmitNextTask(req, pool)) {
+      conn->unqueued = req;
+      AddWaiting(conn);
+      break;
+    }
+  }
+  return true;
+}
+
+// Consumes every complete frame in the input buffer, as long as the
+// connection is below its pipeline limit.
+static bool ParseFrames(struct Connection *conn, struct WorkerPool *pool) {
+  size_t offset = 0;
+  bool ok = true;
+  while (ok && conn->in_flight < MAX_PIPELINE && !conn->unqueued) {
+    struct FrameHeader header;
+    int decoded =
+        DecodeHeader(conn->in + offset, conn->in_len - offset, &header);
+    if (decoded < 0 || (decoded > 0 && header.type != FRAME_REQUEST)) {
+      fprintf(stderr, "Client sent a malformed frame\n");
+      return false;
+    }
+    if (decoded == 0)
+      break;
+    size_t frame_size = FRAME_HEADER_SIZE + FramePayloadSize(&header);
+    if (conn->in_len - offset < frame_size) {
+      // Make sure the whole frame fits once it arrives
+      if (frame_size > conn->in_cap) {
+        char *in = realloc(conn->in, frame_size);
+        if (!in)
+          return false;
+        conn->in = in;
+        conn->in_cap = frame_size;
+      }
+      break;
+    }
+
+    ok = HandleRequest(conn, pool, &header,
+                       conn->in + offset + FRAME_HEADER_SIZE);
+    offset += frame_size;
   }
 
-  return result % mod;
+  memmove(conn->in, conn->in + offset, conn->in_len - offset);
+  conn->in_len -= offset;
+  // Error frames are answered right here, no completion will send them
+  if (ok && conn->out_len > conn->out_sent)
+    ok = FlushOutput(conn);
+  return ok;
 }
 
-uint64_t Factorial(const struct FactorialArgs *args) {
-  uint64_t ans = 1;
+// Reads until EAGAIN (edge-triggered) and hands complete frames to the
+// pool. When the connection is at its pipeline or output limit or waits
+// for the pool queue, the rest stays in the socket buffer and is picked
+// up after a completion or a flush, which call ReadInput again.
+static bool ReadInput(struct Connection *conn, struct WorkerPool *pool) {
+  while (true) {
+    if (!ParseFrames(conn, pool))
+      return false;
+    if (conn->in_flight >= MAX_PIPELINE || conn->unqueued ||
+        conn->out_len - conn->out_sent > MAX_PENDING_OUTPUT)
+      return true;
+
+    ssize_t n = recv(conn->fd, conn->in + conn->in_len,
+                     conn->in_cap - conn->in_len, 0);
+    if (n == 0)
+      return false;
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return true;
+      fprintf(stderr, "Client read failed\n");
+      return false;
+    }
+    conn->in_len += (size_t)n;
+  }
+}
 
-  // TODO: your code here
+static bool AppendResponse(struct Connection *conn, struct Request *req) {
+  char *at =
+      ReserveOutput(conn, FRAME_HEADER_SIZE + req->count * FRAME_RESULT_SIZE);
+  if (!at)
+    return false;
+  struct FrameHeader header = {PROTO_VERSION, FRAME_RESPONSE,
+                               (uint16_t)req->count, req->id};
+  EncodeHeader(at, &header);
+  for (int i = 0; i < req->count; i++) {
+    if (verbose)
+      printf("Total: %" PRIu64 "\n", req->results[i]);
+    PutU64(at + FRAME_HEADER_SIZE + i * FRAME_RESULT_SIZE, req->results[i]);
+  }
+  return true;
+}
 
-  return ans;
+// Submits the rest of the waiting requests while the pool queue has room,
+// one task per connection in turn, so a small request is not stuck behind
+// a batch of thousands of ranges. A connection whose request is fully
+// queued is read again: frames left in its socket will not bring a new
+// edge. The tasks of a closed connection are queued too, its request
+// still has to come back before the connection can be freed.
+static void ResumeSubmissions(struct WorkerPool *pool) {
+  while (waiting_head) {
+    struct Connection *conn = waiting_head;
+    struct Request *req = conn->unqueued;
+    if (!SubmitNextTask(req, pool))
+      return;
+    waiting_head = conn->next_waiting;
+    if (!waiting_head)
+      waiting_tail = NULL;
+    if (req->submitted < req->tasks_num) {
+      AddWaiting(conn);
+      continue;
+    }
+    conn->unqueued = NULL;
+    if (!conn->closed && !ReadInput(conn, pool))
+      CloseConnection(conn);
+  }
 }
 
-void *ThreadFactorial(void *args) {
-  struct FactorialArgs *fargs = (struct FactorialArgs *)args;
-  return (void *)(uint64_t *)Factorial(fargs);
+// Turns finished requests into response frames. The eventfd also fires
+// when a pool thread frees a queue slot the reactor is waiting for.
+static void DrainCompletions(struct WorkerPool *pool) {
+  uint64_t count;
+  while (read(done_fd, &count, sizeof(count)) > 0)
+    ;
+  ResumeSubmissions(pool);
+
+  pthread_mutex_lock(&done_mutex);
+  struct Request *pushed = done_head;
+  done_head = NULL;
+  pthread_mutex_unlock(&done_mutex);
+
+  // The list is pushed LIFO; answer in completion order
+  struct TraceSpan respond = TraceBegin("send responses");
+  int responses = 0;
+  struct Request *req = NULL;
+  while (pushed) {
+    struct Request *next = pushed->next;
+    pushed->next = req;
+    req = pushed;
+    pushed = next;
+  }
+
+  while (req) {
+    struct Request *next = req->next;
+    struct Connection *conn = req->conn;
+    conn->in_flight--;
+
+    if (conn->closed) {
+      if (conn->in_flight == 0)
+        CloseConnection(conn);
+    } else if (!AppendResponse(conn, req) || !FlushOutput(conn) ||
+               !ReadInput(conn, pool)) {
+      // ReadInput: frames held back by the pipeline limit may be waiting
+      // with no new edge coming
+      CloseConnection(conn);
+    }
+    free(req);
+    req = next;
+    responses++;
+  }
+  TraceEndArg(respond, responses);
+}
+
+static void AcceptConnections(int server_fd, int epoll_fd) {
+  while (true) {
+    int client_fd = accept4(server_fd, NULL, NULL, SOCK_NONBLOCK);
+    if (client_fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        fprintf(stderr, "Could not establish new connection\n");
+      return;
+    }
+
+    struct Connection *conn = calloc(1, sizeof(struct Connection));
+    if (!conn) {
+      close(client_fd);
+      continue;
+    }
+    conn->fd = client_fd;
+    conn->in = malloc(INPUT_BUFFER_SIZE);
+    conn->in_cap = INPUT_BUFFER_SIZE;
+    if (!conn->in) {
+      close(client_fd);
+      free(conn);
+      continue;
+    }
+
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                             .data.ptr = conn};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+      close(client_fd);
+      free(conn->in);
+      free(conn);
+    }
+  }
 }
 
 int main(int argc, char **argv) {
   int tnum = -1;
   int port = -1;
+  int pool_size = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int cache_mb = 64;
+  const char *trace_path = NULL;
 
   while (true) {
     int current_optind = optind ? optind : 1;
 
     static struct option options[] = {{"port", required_argument, 0, 0},
                                       {"tnum", required_argument, 0, 0},
+                                      {"verbose", no_argument, 0, 0},
+                                      {"pool-size", required_argument, 0, 0},
+                                      {"cache-mb", required_argument, 0, 0},
+                                      {"trace", required_argument, 0, 0},
                                       {0, 0, 0, 0}};
 
     int option_index = 0;
@@ -73,6 +601,18 @@ int main(int argc, char **argv) {
         tnum = atoi(optarg);
         // TODO: your code here
         break;
+      case 2:
+        verbose = true;
+        break;
+      case 3:
+        pool_size = atoi(optarg);
+        break;
+      case 4:
+        cache_mb = atoi(optarg);
+        break;
+      case 5:
+        trace_path = optarg;
+        break;
       default:
         printf("Index %d is out of options\n", option_index);
       }
@@ -86,12 +626,25 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (port == -1 || tnum == -1) {
-    fprintf(stderr, "Using: %s --port 20001 --tnum 4\n", argv[0]);
+  if (port == -1 || tnum <= 0 || pool_size <= 0 || cache_mb < 0) {
+    fprintf(stderr,
+            "Using: %s --port 20001 --tnum 4 [--pool-size N] [--cache-mb 64] "
+            "[--verbose] [--trace FILE]\n",
+            argv[0]);
     return 1;
   }
+  split = tnum;
+  TraceInit(trace_path);
+  TraceSetThreadName("reactor");
+  if (cache_mb > 0) {
+    cache = FactorialCacheCreate((size_t)cache_mb << 20);
+    if (!cache) {
+      fprintf(stderr, "Could not allocate the result cache\n");
+      return 1;
+    }
+  }
 
-  int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
   if (server_fd < 0) {
     fprintf(stderr, "Can not create server socket!");
     return 1;
@@ -117,80 +670,92 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  printf("Server listening at %d\n", port);
+  // SIGUSR1 prints the cache counters and writes out the trace recorded so
+  // far (the server only stops when killed, so atexit never runs); it is
+  // taken through a signalfd so it is blocked before the pool threads
+  // inherit the mask
+  sigset_t stats_mask;
+  sigemptyset(&stats_mask);
+  sigaddset(&stats_mask, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &stats_mask, NULL);
+  int stats_fd = signalfd(-1, &stats_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  struct WorkerPool *pool =
+      WorkerPoolCreate(pool_size, pool_size * QUEUE_PER_THREAD);
+  if (!pool) {
+    fprintf(stderr, "Could not start worker pool\n");
+    return 1;
+  }
 
-  while (true) {
-    struct sockaddr_in client;
-    socklen_t client_len = sizeof(client);
-    int client_fd = accept(server_fd, (struct sockaddr *)&client, &client_len);
+  done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (done_fd < 0 || epoll_fd < 0 || stats_fd < 0) {
+    perror("epoll");
+    return 1;
+  }
 
-    if (client_fd < 0) {
-      fprintf(stderr, "Could not establish new connection\n");
-      continue;
-    }
+  // data.ptr == NULL marks the listening socket, &done_fd the eventfd,
+  // &stats_fd the signalfd
+  struct epoll_event ev = {.events = EPOLLIN | EPOLLET, .data.ptr = NULL};
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
+  ev.data.ptr = &done_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, done_fd, &ev);
+  ev.data.ptr = &stats_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stats_fd, &ev);
 
-    while (true) {
-      unsigned int buffer_size = sizeof(uint64_t) * 3;
-      char from_client[buffer_size];
-      int read = recv(client_fd, from_client, buffer_size, 0);
+  printf("Server listening at %d (pool %d threads, split %d, cache %d MiB)\n",
+         port, pool_size, tnum, cache_mb);
+  fflush(stdout);
 
-      if (!read)
-        break;
-      if (read < 0) {
-        fprintf(stderr, "Client read failed\n");
-        break;
-      }
-      if (read < buffer_size) {
-        fprintf(stderr, "Client send wrong data format\n");
-        break;
-      }
+  struct epoll_event events[MAX_EVENTS];
+  while (true) {
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait");
+      break;
+    }
 
-      pthread_t threads[tnum];
-
-      uint64_t begin = 0;
-      uint64_t end = 0;
-      uint64_t mod = 0;
-      memcpy(&begin, from_client, sizeof(uint64_t));
-      memcpy(&end, from_client + sizeof(uint64_t), sizeof(uint64_t));
-      memcpy(&mod, from_client + 2 * sizeof(uint64_t), sizeof(uint64_t));
-
-      fprintf(stdout, "Receive: %llu %llu %llu\n", begin, end, mod);
-
-      struct FactorialArgs args[tnum];
-      for (uint32_t i = 0; i < tnum; i++) {
-        // TODO: parallel somehow
-        args[i].begin = 1;
-        args[i].end = 1;
-        args[i].mod = mod;
-
-        if (pthread_create(&threads[i], NULL, ThreadFactorial,
-                           (void *)&args[i])) {
-          printf("Error: pthread_create failed!\n");
-          return 1;
-        }
+    for (int i = 0; i < n; i++) {
+      void *ptr = events[i].data.ptr;
+      if (ptr == NULL) {
+        AcceptConnections(server_fd, epoll_fd);
+        continue;
       }
-
-      uint64_t total = 1;
-      for (uint32_t i = 0; i < tnum; i++) {
-        uint64_t result = 0;
-        pthread_join(threads[i], (void **)&result);
-        total = MultModulo(total, result, mod);
+      if (ptr == &done_fd) {
+        DrainCompletions(pool);
+        continue;
       }
-
-      printf("Total: %llu\n", total);
-
-      char buffer[sizeof(total)];
-      memcpy(buffer, &total, sizeof(total));
-      err = send(client_fd, buffer, sizeof(total), 0);
-      if (err < 0) {
-        fprintf(stderr, "Can't send data to client\n");
-        break;
+      if (ptr == &stats_fd) {
+        struct signalfd_siginfo info;
+        while (read(stats_fd, &info, sizeof(info)) > 0)
+          ;
+        PrintCacheStats();
+        TraceFlush();
+        continue;
       }
-    }
 
-    shutdown(client_fd, SHUT_RDWR);
-    close(client_fd);
+      struct Connection *conn = (struct Connection *)ptr;
+      if (conn->closed)
+        continue;
+      uint32_t what = events[i].events;
+      bool ok = !(what & EPOLLERR);
+      if (ok && (what & EPOLLOUT))
+        ok = FlushOutput(conn);
+      if (ok && (what & (EPOLLIN | EPOLLRDHUP | EPOLLOUT)))
+        ok = ReadInput(conn, pool);
+      if (!ok)
+        CloseConnection(conn);
+    }
+    FreeDeadConnections();
   }
 
+  WorkerPoolDestroy(pool);
+  FactorialCacheDestroy(cache);
+  close(stats_fd);
+  close(epoll_fd);
+  close(done_fd);
+  close(server_fd);
   return 0;
 }
@@ -0,0 +1,131 @@
+#include "worker_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+struct PoolTask {
+  PoolTaskFunc func;
+  void *arg;
+};
+
+// Ring buffer of capacity slots guarded by one mutex; producers wait on
+// not_full, workers on not_empty.
+struct WorkerPool {
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  struct PoolTask *tasks;
+  int capacity;
+  int head;
+  int count;
+  bool shutdown;
+  int threads_num;
+  pthread_t *threads;
+};
+
+static void *WorkerLoop(void *arg) {
+  struct WorkerPool *pool = (struct WorkerPool *)arg;
+
+  while (true) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->count == 0 && !pool->shutdown)
+      pthread_cond_wait(&pool->not_empty, &pool->mutex);
+    if (pool->count == 0) {
+      pthread_mutex_unlock(&pool->mutex);
+      break;
+    }
+    struct PoolTask task = pool->tasks[pool->head];
+    pool->head = (pool->head + 1) % pool->capacity;
+    pool->count--;
+    pthread_cond_signal(&pool->not_full);
+    pthread_mutex_unlock(&pool->mutex);
+
+    task.func(task.arg);
+  }
+
+  return NULL;
+}
+
+struct WorkerPool *WorkerPoolCreate(int threads_num, int queue_capacity) {
+  if (threads_num <= 0 || queue_capacity <= 0)
+    return NULL;
+  struct WorkerPool *pool = calloc(1, sizeof(struct WorkerPool));
+  if (pool == NULL)
+    return NULL;
+  pool->threads = calloc(threads_num, sizeof(pthread_t));
+  pool->tasks = calloc(queue_capacity, sizeof(struct PoolTask));
+  if (pool->threads == NULL || pool->tasks == NULL) {
+    free(pool->threads);
+    free(pool->tasks);
+    free(pool);
+    return NULL;
+  }
+  pool->capacity = queue_capacity;
+
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->not_empty, NULL);
+  pthread_cond_init(&pool->not_full, NULL);
+
+  for (int i = 0; i < threads_num; i++) {
+    if (pthread_create(&pool->threads[i], NULL, WorkerLoop, pool)) {
+      pool->threads_num = i;
+      WorkerPoolDestroy(pool);
+      return NULL;
+    }
+  }
+  pool->threads_num = threads_num;
+  return pool;
+}
+
+// Appends a task; the caller holds the mutex and has checked for room
+static void PushTask(struct WorkerPool *pool, PoolTaskFunc func, void *arg) {
+  int tail = (pool->head + pool->count) % pool->capacity;
+  pool->tasks[tail].func = func;
+  pool->tasks[tail].arg = arg;
+  pool->count++;
+  pthread_cond_signal(&pool->not_empty);
+}
+
+bool WorkerPoolSubmit(struct WorkerPool *pool, PoolTaskFunc func, void *arg) {
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->count == pool->capacity && !pool->shutdown)
+    pthread_cond_wait(&pool->not_full, &pool->mutex);
+  if (pool->shutdown) {
+    pthread_mutex_unlock(&pool->mutex);
+    return false;
+  }
+  PushTask(pool, func, arg);
+  pthread_mutex_unlock(&pool->mutex);
+  return true;
+}
+
+bool WorkerPoolTrySubmit(struct WorkerPool *pool, PoolTaskFunc func,
+                         void *arg) {
+  pthread_mutex_lock(&pool->mutex);
+  bool queued = pool->count < pool->capacity && !pool->shutdown;
+  if (queued)
+    PushTask(pool, func, arg);
+  pthread_mutex_unlock(&pool->mutex);
+  return queued;
+}
+
+void WorkerPoolDestroy(struct WorkerPool *pool) {
+  if (pool == NULL)
+    return;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->not_empty);
+  pthread_cond_broadcast(&pool->not_full);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (int i = 0; i < pool->threads_num; i++)
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_cond_destroy(&pool->not_full);
+  pthread_cond_destroy(&pool->not_empty);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->tasks);
+  free(pool->threads);
+  free(pool);
+}
@@ -0,0 +1,28 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdbool.h>
+
+// Fixed set of threads started once and fed through a bounded MPMC task
+// queue, so requests do not pay for pthread_create/pthread_join.
+typedef void (*PoolTaskFunc)(void *arg);
+
+struct WorkerPool;
+
+// queue_capacity is the number of tasks that may wait in the queue.
+struct WorkerPool *WorkerPoolCreate(int threads_num, int queue_capacity);
+
+// Queues func(arg) for execution on one of the pool threads. Any thread
+// may submit; the call blocks while the queue is full.
+bool WorkerPoolSubmit(struct WorkerPool *pool, PoolTaskFunc func, void *arg);
+
+// Same as WorkerPoolSubmit, but returns false instead of waiting when the
+// queue is full (or the pool is shutting down), so an event loop never
+// stalls on it.
+bool WorkerPoolTrySubmit(struct WorkerPool *pool, PoolTaskFunc func,
+                         void *arg);
+
+// Finishes the queued tasks and joins the threads.
+void WorkerPoolDestroy(struct WorkerPool *pool);
+
+#endif
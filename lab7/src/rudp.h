@@ -0,0 +1,80 @@
+#ifndef RUDP_H
+#define RUDP_H
+
+#include <arpa/inet.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Reliable transfer over UDP shared by udpclient --send and udpserver
+// --receive. Every datagram starts with a 16-byte header in network order:
+//
+//   u8 type | u8 flags | u16 len | u32 session | u32 seq | u32 ts
+//
+// DATA carries len payload bytes of segment seq; the last segment has
+// RUDP_FIN set and no payload. ACK acknowledges everything below seq
+// (cumulative), echoes ts of the segment that triggered it (so the sender
+// can sample RTT even for retransmissions) and is followed by a selective
+// ack bitmap: bit i set means segment seq + 1 + i is already buffered.
+#define RUDP_HEADER_SIZE 16
+#define RUDP_MSS 1400
+#define RUDP_MAX_WINDOW 1024
+#define RUDP_SACK_BYTES (RUDP_MAX_WINDOW / 8)
+#define RUDP_ACK_SIZE (RUDP_HEADER_SIZE + RUDP_SACK_BYTES)
+// Silence after which either side considers the peer gone
+#define RUDP_IDLE_LIMIT_US 10000000
+
+enum RudpType { RUDP_DATA = 1, RUDP_ACK = 2 };
+enum RudpFlags { RUDP_FIN = 1 };
+
+struct RudpHeader {
+  uint8_t type;
+  uint8_t flags;
+  uint16_t len;
+  uint32_t session;
+  uint32_t seq;
+  uint32_t ts;
+};
+
+static inline void RudpEncode(char *buf, const struct RudpHeader *h) {
+  uint16_t len = htons(h->len);
+  uint32_t session = htonl(h->session);
+  uint32_t seq = htonl(h->seq);
+  uint32_t ts = htonl(h->ts);
+  buf[0] = (char)h->type;
+  buf[1] = (char)h->flags;
+  memcpy(buf + 2, &len, 2);
+  memcpy(buf + 4, &session, 4);
+  memcpy(buf + 8, &seq, 4);
+  memcpy(buf + 12, &ts, 4);
+}
+
+// Returns false for datagrams too short to hold a header
+static inline bool RudpDecode(const char *buf, size_t size,
+                              struct RudpHeader *h) {
+  if (size < RUDP_HEADER_SIZE)
+    return false;
+  uint16_t len;
+  uint32_t session, seq, ts;
+  memcpy(&len, buf + 2, 2);
+  memcpy(&session, buf + 4, 4);
+  memcpy(&seq, buf + 8, 4);
+  memcpy(&ts, buf + 12, 4);
+  h->type = (uint8_t)buf[0];
+  h->flags = (uint8_t)buf[1];
+  h->len = ntohs(len);
+  h->session = ntohl(session);
+  h->seq = ntohl(seq);
+  h->ts = ntohl(ts);
+  return true;
+}
+
+static inline bool RudpSackTest(const char *sack, uint32_t bit) {
+  return (sack[bit / 8] >> (bit % 8)) & 1;
+}
+
+static inline void RudpSackSet(char *sack, uint32_t bit) {
+  sack[bit / 8] |= (char)(1 << (bit % 8));
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SADDR struct sockaddr
+#define SEND_CHUNK (1024 * 1024)
+// Small payloads are repeated until at least this much has been sent
+#define MIN_TOTAL (256ULL * 1024 * 1024)
+
+// Ingest throughput of a running tcpserver (any --mode except echo).
+// For every payload size it opens a connection, sends the payload, shuts
+// the write side down and waits for the server to close: the time covers
+// the server draining everything into its output.
+// Usage: ./tcp_ingest_bench <ip> <port> [max payload, default 10G]
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool SendPayload(const struct sockaddr_in *addr, const char *chunk,
+                        unsigned long long size) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return false;
+  }
+  if (connect(fd, (SADDR *)addr, sizeof(*addr)) < 0) {
+    perror("connect");
+    close(fd);
+    return false;
+  }
+
+  unsigned long long left = size;
+  while (left > 0) {
+    size_t len = left < SEND_CHUNK ? (size_t)left : SEND_CHUNK;
+    ssize_t n = send(fd, chunk, len, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("send");
+      close(fd);
+      return false;
+    }
+    left -= (unsigned long long)n;
+  }
+
+  shutdown(fd, SHUT_WR);
+  char byte;
+  while (recv(fd, &byte, 1, 0) > 0)
+    ; // an echo server would send data back; the ingest modes send none
+  close(fd);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    printf("usage: %s <ip> <port> [max payload bytes]\n", argv[0]);
+    exit(1);
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(atoi(argv[2]));
+  if (inet_pton(AF_INET, argv[1], &addr.sin_addr) <= 0) {
+    perror("bad address");
+    exit(1);
+  }
+  unsigned long long max_size =
+      argc > 3 ? strtoull(argv[3], NULL, 10) : 10ULL * 1024 * 1024 * 1024;
+
+  char *chunk = malloc(SEND_CHUNK);
+  if (chunk == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  memset(chunk, 'x', SEND_CHUNK);
+
+  printf("%14s %10s %10s\n", "payload", "repeats", "GB/s");
+  for (unsigned long long size = 1024; size <= max_size; size *= 8) {
+    unsigned long long repeats = size < MIN_TOTAL ? MIN_TOTAL / size : 1;
+    // 1 KB payloads are dominated by connection setup; cap the count
+    if (repeats > 20000)
+      repeats = 20000;
+
+    double start = NowSeconds();
+    for (unsigned long long i = 0; i < repeats; i++) {
+      if (!SendPayload(&addr, chunk, size))
+        exit(1);
+    }
+    double elapsed = NowSeconds() - start;
+    printf("%14llu %10llu %10.3f\n", size, repeats,
+           size * repeats / elapsed / 1e9);
+    fflush(stdout);
+
+    // Finish with exactly max_size (10 GB by default)
+    if (size < max_size && size * 8 > max_size)
+      size = max_size / 8;
+  }
+
+  free(chunk);
+  return 0;
+}
@@ -0,0 +1,281 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SADDR struct sockaddr
+#define MAX_EVENTS 1024
+
+// Load generator for tcpserver --mode echo. Keeps --connections sockets
+// busy: each one connects, sends --messages messages of --size bytes,
+// waits for every echo, closes and connects again. Reports completed connections/s and
+// echoed bytes/s. Single-threaded, one state machine per socket.
+enum ClientState { CLIENT_CONNECTING, CLIENT_SENDING, CLIENT_RECEIVING };
+
+struct Client {
+  int fd;
+  enum ClientState state;
+  size_t sent;
+  size_t received;
+  int messages_left;
+};
+
+struct LoadOptions {
+  struct sockaddr_in addr;
+  int connections;
+  double duration;
+  size_t size;
+  int messages;
+};
+
+static char *message;
+static char *sink;
+static unsigned long long connections_done = 0;
+static unsigned long long bytes_echoed = 0;
+static unsigned long long messages_echoed = 0;
+static unsigned long long errors = 0;
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void RaiseFileLimit(void) {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static bool StartClient(struct Client *client, int epfd,
+                        const struct LoadOptions *opts) {
+  client->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (client->fd < 0) {
+    perror("socket");
+    return false;
+  }
+  int one = 1;
+  setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(client->fd, (SADDR *)&opts->addr, sizeof(opts->addr)) < 0 &&
+      errno != EINPROGRESS) {
+    close(client->fd);
+    client->fd = -1;
+    return false;
+  }
+  client->state = CLIENT_CONNECTING;
+  client->sent = client->received = 0;
+  client->messages_left = opts->messages;
+
+  struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLET,
+                           .data.ptr = client};
+  epoll_ctl(epfd, EPOLL_CTL_ADD, client->fd, &ev);
+  return true;
+}
+
+// Returns false when the socket is done (closed normally or failed)
+static bool StepClient(struct Client *client, const struct LoadOptions *opts) {
+  if (client->state == CLIENT_CONNECTING) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 ||
+        error != 0) {
+      errors++;
+      return false;
+    }
+    client->state = CLIENT_SENDING;
+  }
+
+  while (true) {
+    if (client->state == CLIENT_SENDING) {
+      while (client->sent < opts->size) {
+        ssize_t n = send(client->fd, message + client->sent,
+                         opts->size - client->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+          if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return true;
+          if (errno == EINTR)
+            continue;
+          errors++;
+          return false;
+        }
+        client->sent += (size_t)n;
+      }
+      client->state = CLIENT_RECEIVING;
+    }
+
+    while (client->received < opts->size) {
+      ssize_t n = recv(client->fd, sink, opts->size - client->received, 0);
+      if (n <= 0) {
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+          return true;
+        if (n < 0 && errno == EINTR)
+          continue;
+        errors++;
+        return false;
+      }
+      client->received += (size_t)n;
+      bytes_echoed += (size_t)n;
+    }
+
+    messages_echoed++;
+    if (--client->messages_left == 0) {
+      connections_done++;
+      return false;
+    }
+    client->state = CLIENT_SENDING;
+    client->sent = client->received = 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *host = "127.0.0.1";
+  int port = 10050;
+  struct LoadOptions opts = {.connections = 1000,
+                             .duration = 5,
+                             .size = 100,
+                             .messages = 10};
+
+  while (true) {
+    static struct option options[] = {{"host", required_argument, 0, 0},
+                                      {"port", required_argument, 0, 0},
+                                      {"connections", required_argument, 0, 0},
+                                      {"duration", required_argument, 0, 0},
+                                      {"size", required_argument, 0, 0},
+                                      {"messages", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 0:
+      switch (option_index) {
+      case 0:
+        host = optarg;
+        break;
+      case 1:
+        port = atoi(optarg);
+        break;
+      case 2:
+        opts.connections = atoi(optarg);
+        break;
+      case 3:
+        opts.duration = atof(optarg);
+        break;
+      case 4:
+        opts.size = (size_t)atol(optarg);
+        break;
+      case 5:
+        opts.messages = atoi(optarg);
+        break;
+      }
+      break;
+
+    case '?':
+      printf("Arguments error\n");
+      break;
+    }
+  }
+
+  memset(&opts.addr, 0, sizeof(opts.addr));
+  opts.addr.sin_family = AF_INET;
+  opts.addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host, &opts.addr.sin_addr) <= 0 ||
+      opts.connections <= 0 || opts.duration <= 0 || opts.size == 0 ||
+      opts.messages <= 0) {
+    fprintf(stderr,
+            "Using: %s [--host 127.0.0.1] [--port 10050] [--connections 1000] "
+            "[--duration 5] [--size 100] [--messages 10]\n",
+            argv[0]);
+    exit(1);
+  }
+  RaiseFileLimit();
+
+  message = malloc(opts.size);
+  sink = malloc(opts.size);
+  struct Client *clients = calloc(opts.connections, sizeof(struct Client));
+  if (message == NULL || sink == NULL || clients == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  memset(message, 'x', opts.size);
+
+  int epfd = epoll_create1(0);
+  if (epfd < 0) {
+    perror("epoll_create1");
+    exit(1);
+  }
+
+  double start = NowSeconds();
+  double stop = start + opts.duration;
+  int active = 0;
+  for (int i = 0; i < opts.connections; i++) {
+    if (StartClient(&clients[i], epfd, &opts))
+      active++;
+    else
+      errors++;
+  }
+
+  struct epoll_event events[MAX_EVENTS];
+  while (active > 0) {
+    int n = epoll_wait(epfd, events, MAX_EVENTS, 100);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait");
+      exit(1);
+    }
+    bool running = NowSeconds() < stop;
+    for (int i = 0; i < n; i++) {
+      struct Client *client = events[i].data.ptr;
+      if (StepClient(client, &opts))
+        continue;
+      close(client->fd);
+      client->fd = -1;
+      active--;
+      // Connect again while the test runs; afterwards just drain
+      if (running) {
+        if (StartClient(client, epfd, &opts))
+          active++;
+        else
+          errors++;
+      }
+    }
+    // Stop waiting for sockets that never finish after the deadline
+    if (!running && NowSeconds() > stop + 5)
+      break;
+  }
+  double elapsed = NowSeconds() - start;
+
+  printf("connections: %d concurrent, %d x %zu bytes each\n", opts.connections,
+         opts.messages, opts.size);
+  printf("completed %llu connections in %.2f s: %.0f conn/s\n",
+         connections_done, elapsed, connections_done / elapsed);
+  printf("echoed %llu messages, %llu bytes: %.0f msg/s, %.2f MB/s\n",
+         messages_echoed, bytes_echoed, messages_echoed / elapsed,
+         bytes_echoed / elapsed / 1e6);
+  printf("errors: %llu\n", errors);
+
+  free(clients);
+  free(message);
+  free(sink);
+  close(epfd);
+  return errors ? 1 : 0;
+}
@@ -1,62 +1,458 @@
+#define _GNU_SOURCE
 #include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #define SERV_PORT 10050
 #define BUFSIZE 100
+#define BACKLOG 5
+#define MAX_EVENTS 1024
 #define SADDR struct sockaddr
+// Bulk ingest: writev mode reads into BULK_IOVECS buffers of BULK_BUFSIZE,
+// splice mode moves up to SPLICE_CHUNK bytes per call through a pipe
+#define BULK_IOVECS 4
+#define BULK_BUFSIZE (256 * 1024)
+#define SPLICE_CHUNK (1024 * 1024)
 
-int main() {
+// Every connection is a small state machine driven by an edge-triggered
+// epoll loop: READING until a chunk arrives, then, in echo mode, WRITING
+// until it has been sent back (and copied to stdout with --stdout) and
+// READING again.
+// A connection costs one struct and a buffer, so tens of thousands of
+// clients are served by one thread.
+enum ConnState { CONN_READING, CONN_WRITING };
+
+struct Connection {
+  int fd;
+  enum ConnState state;
+  size_t len;  // bytes in buf
+  size_t sent; // bytes of buf already echoed
+  char buf[];  // bufsize bytes
+};
+
+// What happens to received data. MODE_COPY, the default, writes it to the
+// output descriptor (stdout unless --output) the original way, one write
+// per bufsize chunk, which is what tcpclient expects: it never reads the
+// socket. MODE_ECHO sends it back to the client, for tcp_loadtest. The
+// bulk modes ingest into the output too: MODE_WRITEV with large
+// readv/writev batches; MODE_SPLICE without copying through user space,
+// socket -> pipe -> output.
+enum ServerMode { MODE_ECHO, MODE_COPY, MODE_WRITEV, MODE_SPLICE };
+
+struct ServerOptions {
+  int port;
+  size_t bufsize;
+  int backlog;
+  bool to_stdout;
+  enum ServerMode mode;
+  int out_fd;
+};
+
+static unsigned long connections_open = 0;
+// Held in reserve: when accept fails with EMFILE it is released to accept
+// and close the pending connection. Otherwise the edge-triggered listener
+// would never report the remaining backlog again.
+static int spare_fd = -1;
+
+// The loop is single-threaded and every ingest step drains what it read
+// into the output before returning, so one pipe and one set of bulk
+// buffers serve all connections
+static int splice_pipe[2] = {-1, -1};
+static char *bulk_buffers[BULK_IOVECS];
+
+// Lets the process hold as many sockets as the hard limit allows
+static void RaiseFileLimit(void) {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static bool AllocBulkBuffers(void) {
+  for (int i = 0; i < BULK_IOVECS; i++) {
+    if (bulk_buffers[i] == NULL)
+      bulk_buffers[i] = malloc(BULK_BUFSIZE);
+    if (bulk_buffers[i] == NULL)
+      return false;
+  }
+  return true;
+}
+
+static void CloseConnection(struct Connection *conn) {
+  close(conn->fd); // also drops it from the epoll set
+  free(conn);
+  connections_open--;
+}
+
+static bool WriteAll(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("write");
+      return false;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+// readv into the bulk buffers, then writev the same bytes out.
+// Returns 1 to go on, 0 when the socket would block, -1 when done.
+static int IngestWritev(struct Connection *conn,
+                        const struct ServerOptions *opts) {
+  struct iovec iov[BULK_IOVECS];
+  for (int i = 0; i < BULK_IOVECS; i++) {
+    iov[i].iov_base = bulk_buffers[i];
+    iov[i].iov_len = BULK_BUFSIZE;
+  }
+  ssize_t n = readv(conn->fd, iov, BULK_IOVECS);
+  if (n == 0)
+    return -1;
+  if (n < 0) {
+    if (errno == EINTR)
+      return 1;
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+  }
+
+  // Trim the vector to what was read and write until all of it is out
+  int count = 0;
+  for (size_t left = (size_t)n; left > 0; count++) {
+    if (iov[count].iov_len > left)
+      iov[count].iov_len = left;
+    left -= iov[count].iov_len;
+  }
+  struct iovec *next = iov;
+  while (count > 0) {
+    ssize_t written = writev(opts->out_fd, next, count);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("writev");
+      return -1;
+    }
+    while (count > 0 && (size_t)written >= next->iov_len) {
+      written -= next->iov_len;
+      next++;
+      count--;
+    }
+    if (count > 0) {
+      next->iov_base = (char *)next->iov_base + written;
+      next->iov_len -= written;
+    }
+  }
+  return 1;
+}
+
+// socket -> pipe -> output, data never enters user space. Not every
+// output takes splice (e.g. O_APPEND files or some ttys): on the first
+// EINVAL the batch already in the pipe is copied out and the server
+// switches to writev for good.
+// Returns 1 to go on, 0 when the socket would block, -1 when done.
+static int IngestSplice(struct Connection *conn, struct ServerOptions *opts) {
+  ssize_t n = splice(conn->fd, NULL, splice_pipe[1], NULL, SPLICE_CHUNK,
+                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (n == 0)
+    return -1;
+  if (n < 0) {
+    if (errno == EINTR)
+      return 1;
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+  }
+
+  // Empty the pipe before the next connection uses it
+  while (n > 0) {
+    ssize_t moved = splice(splice_pipe[0], NULL, opts->out_fd, NULL, (size_t)n,
+                           SPLICE_F_MOVE);
+    if (moved < 0 && errno == EINVAL) {
+      if (opts->mode == MODE_SPLICE) {
+        fprintf(stderr,
+                "splice to the output is not supported, using writev\n");
+        if (!AllocBulkBuffers()) {
+          fprintf(stderr, "Out of memory\n");
+          exit(1);
+        }
+        opts->mode = MODE_WRITEV;
+      }
+      char buf[64 * 1024];
+      moved = read(splice_pipe[0], buf, (size_t)n < sizeof(buf) ? (size_t)n
+                                                                : sizeof(buf));
+      if (moved > 0 && !WriteAll(opts->out_fd, buf, (size_t)moved))
+        return -1;
+    }
+    if (moved < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("splice");
+      return -1;
+    }
+    n -= moved;
+  }
+  return 1;
+}
+
+// Runs the connection until the socket would block. Returns false when
+// the connection is finished (peer closed or error).
+static bool StepConnection(struct Connection *conn, struct ServerOptions *opts) {
+  if (opts->mode == MODE_WRITEV || opts->mode == MODE_SPLICE) {
+    while (true) {
+      int status = opts->mode == MODE_SPLICE ? IngestSplice(conn, opts)
+                                             : IngestWritev(conn, opts);
+      if (status <= 0)
+        return status == 0;
+    }
+  }
+
+  while (true) {
+    switch (conn->state) {
+    case CONN_READING: {
+      ssize_t n = recv(conn->fd, conn->buf, opts->bufsize, 0);
+      if (n == 0)
+        return false;
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+          return true;
+        if (errno != ECONNRESET)
+          perror("read");
+        return false;
+      }
+      if (opts->mode == MODE_COPY) {
+        if (!WriteAll(opts->out_fd, conn->buf, (size_t)n))
+          return false;
+        break;
+      }
+      conn->len = (size_t)n;
+      conn->sent = 0;
+      conn->state = CONN_WRITING;
+      if (opts->to_stdout && write(1, conn->buf, conn->len) < 0)
+        perror("write");
+    } break;
+
+    case CONN_WRITING:
+      while (conn->sent < conn->len) {
+        ssize_t n = send(conn->fd, conn->buf + conn->sent,
+                         conn->len - conn->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+          if (errno == EINTR)
+            continue;
+          if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return true; // EPOLLOUT will resume us
+          return false;
+        }
+        conn->sent += (size_t)n;
+      }
+      conn->state = CONN_READING;
+      break;
+    }
+  }
+}
+
+static void AcceptConnections(int lfd, int epfd,
+                              const struct ServerOptions *opts) {
+  while (true) {
+    int cfd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (cfd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if ((errno == EMFILE || errno == ENFILE) && spare_fd >= 0) {
+        fprintf(stderr, "accept: out of descriptors at %lu connections\n",
+                connections_open);
+        close(spare_fd);
+        int rejected = accept(lfd, NULL, NULL);
+        if (rejected >= 0)
+          close(rejected);
+        spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        perror("accept");
+      return;
+    }
+
+    struct Connection *conn = malloc(sizeof(struct Connection) + opts->bufsize);
+    if (conn == NULL) {
+      close(cfd);
+      continue;
+    }
+    conn->fd = cfd;
+    conn->state = CONN_READING;
+    conn->len = conn->sent = 0;
+
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                             .data.ptr = conn};
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &ev) < 0) {
+      perror("epoll_ctl");
+      close(cfd);
+      free(conn);
+      continue;
+    }
+    connections_open++;
+  }
+}
+
+int main(int argc, char **argv) {
   const size_t kSize = sizeof(struct sockaddr_in);
+  struct ServerOptions opts = {SERV_PORT, BUFSIZE, BACKLOG, false, MODE_COPY, 1};
+  const char *output = NULL;
+
+  while (true) {
+    static struct option options[] = {{"port", required_argument, 0, 0},
+                                      {"bufsize", required_argument, 0, 0},
+                                      {"backlog", required_argument, 0, 0},
+                                      {"stdout", no_argument, 0, 0},
+                                      {"mode", required_argument, 0, 0},
+                                      {"output", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+
+    if (c == -1)
+      break;
 
-  int lfd, cfd;
-  int nread;
-  char buf[BUFSIZE];
+    switch (c) {
+    case 0:
+      switch (option_index) {
+      case 0:
+        opts.port = atoi(optarg);
+        break;
+      case 1:
+        opts.bufsize = (size_t)atol(optarg);
+        break;
+      case 2:
+        opts.backlog = atoi(optarg);
+        break;
+      case 3:
+        opts.to_stdout = true;
+        break;
+      case 4:
+        if (strcmp(optarg, "echo") == 0)
+          opts.mode = MODE_ECHO;
+        else if (strcmp(optarg, "copy") == 0)
+          opts.mode = MODE_COPY;
+        else if (strcmp(optarg, "writev") == 0)
+          opts.mode = MODE_WRITEV;
+        else if (strcmp(optarg, "splice") == 0)
+          opts.mode = MODE_SPLICE;
+        else
+          opts.port = -1; // reported by the usage check below
+        break;
+      case 5:
+        output = optarg;
+        break;
+      }
+      break;
+
+    case '?':
+      printf("Arguments error\n");
+      break;
+    }
+  }
+
+  if (opts.port <= 0 || opts.port > 65535 || opts.bufsize == 0 ||
+      opts.backlog <= 0) {
+    fprintf(stderr,
+            "Using: %s [--port %d] [--bufsize %d] [--backlog %d] [--stdout]\n"
+            "          [--mode copy|echo|writev|splice] [--output FILE]\n",
+            argv[0], SERV_PORT, BUFSIZE, BACKLOG);
+    exit(1);
+  }
+  if (output != NULL) {
+    opts.out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (opts.out_fd < 0) {
+      perror(output);
+      exit(1);
+    }
+  }
+  if (opts.mode == MODE_SPLICE) {
+    if (pipe2(splice_pipe, O_CLOEXEC) < 0) {
+      perror("pipe");
+      exit(1);
+    }
+    fcntl(splice_pipe[1], F_SETPIPE_SZ, SPLICE_CHUNK);
+  }
+  if (opts.mode == MODE_WRITEV && !AllocBulkBuffers()) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  RaiseFileLimit();
+  spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+  int lfd;
   struct sockaddr_in servaddr;
-  struct sockaddr_in cliaddr;
 
-  if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+  if ((lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {
     perror("socket");
     exit(1);
   }
+  int one = 1;
+  setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
 
   memset(&servaddr, 0, kSize);
   servaddr.sin_family = AF_INET;
   servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-  servaddr.sin_port = htons(SERV_PORT);
+  servaddr.sin_port = htons(opts.port);
 
   if (bind(lfd, (SADDR *)&servaddr, kSize) < 0) {
     perror("bind");
     exit(1);
   }
 
-  if (listen(lfd, 5) < 0) {
+  if (listen(lfd, opts.backlog) < 0) {
     perror("listen");
     exit(1);
   }
 
-  while (1) {
-    unsigned int clilen = kSize;
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    perror("epoll_create1");
+    exit(1);
+  }
+  // data.ptr == NULL marks the listening socket
+  struct epoll_event ev = {.events = EPOLLIN | EPOLLET, .data.ptr = NULL};
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev) < 0) {
+    perror("epoll_ctl");
+    exit(1);
+  }
+  static const char *mode_names[] = {"echo", "copy", "writev", "splice"};
+  fprintf(stderr, "listening on %d (mode %s, bufsize %zu, backlog %d)\n",
+          opts.port, mode_names[opts.mode], opts.bufsize, opts.backlog);
 
-    if ((cfd = accept(lfd, (SADDR *)&cliaddr, &clilen)) < 0) {
-      perror("accept");
+  struct epoll_event events[MAX_EVENTS];
+  while (1) {
+    int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait");
       exit(1);
     }
-    printf("connection established\n");
-
-    while ((nread = read(cfd, buf, BUFSIZE)) > 0) {
-      write(1, &buf, nread);
-    }
 
-    if (nread == -1) {
-      perror("read");
-      exit(1);
+    for (int i = 0; i < n; i++) {
+      struct Connection *conn = events[i].data.ptr;
+      if (conn == NULL) {
+        AcceptConnections(lfd, epfd, &opts);
+        continue;
+      }
+      if ((events[i].events & EPOLLERR) || !StepConnection(conn, &opts))
+        CloseConnection(conn);
     }
-    close(cfd);
   }
 }
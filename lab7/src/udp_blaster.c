@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define MAX_BATCH 1024
+#define MAX_SIZE 65507
+
+// Open-loop packet generator for udpserver: every thread owns a connected
+// UDP socket (so the server's SO_REUSEPORT hash spreads them across its
+// workers), pushes sendmmsg batches as fast as it can and drains whatever
+// echoes came back with a non-blocking recvmmsg in between.
+struct BlastArgs {
+  struct sockaddr_in server;
+  int size;
+  int batch;
+  double duration;
+  unsigned long long sent;
+  unsigned long long received;
+  int errors;
+};
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int Drain(int fd, struct mmsghdr *msgs, int batch, int flags) {
+  int total = 0;
+  while (true) {
+    int n = recvmmsg(fd, msgs, batch, flags, NULL);
+    if (n <= 0)
+      return total;
+    total += n;
+    flags |= MSG_DONTWAIT;
+  }
+}
+
+static void *BlastThread(void *arg) {
+  struct BlastArgs *args = (struct BlastArgs *)arg;
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0 ||
+      connect(fd, (struct sockaddr *)&args->server, sizeof(args->server)) < 0) {
+    perror("socket/connect");
+    args->errors++;
+    if (fd >= 0)
+      close(fd);
+    return NULL;
+  }
+  int bufsize = 4 * 1024 * 1024;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+
+  // All datagrams of a batch share one payload on send; receives land in
+  // a single scratch buffer since echoes are only counted
+  char *payload = calloc(1, args->size);
+  char *scratch = malloc(MAX_SIZE);
+  struct mmsghdr *out = calloc(args->batch, sizeof(struct mmsghdr));
+  struct mmsghdr *in = calloc(args->batch, sizeof(struct mmsghdr));
+  if (!payload || !scratch || !out || !in) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  memset(payload, 'x', args->size);
+  struct iovec out_iov = {payload, args->size};
+  struct iovec in_iov = {scratch, MAX_SIZE};
+  for (int i = 0; i < args->batch; i++) {
+    out[i].msg_hdr.msg_iov = &out_iov;
+    out[i].msg_hdr.msg_iovlen = 1;
+    in[i].msg_hdr.msg_iov = &in_iov;
+    in[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  double stop = NowSeconds() + args->duration;
+  while (NowSeconds() < stop) {
+    int n = sendmmsg(fd, out, args->batch, 0);
+    if (n < 0) {
+      // A full socket buffer or an ICMP error from a missing server;
+      // neither should end the run
+      if (errno != EAGAIN && errno != ENOBUFS && errno != ECONNREFUSED &&
+          errno != EINTR) {
+        perror("sendmmsg");
+        args->errors++;
+        break;
+      }
+      n = 0;
+    }
+    args->sent += n;
+    args->received += Drain(fd, in, args->batch, MSG_DONTWAIT);
+  }
+
+  // Give the echoes still in flight a moment to arrive
+  struct timeval linger = {0, 100000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &linger, sizeof(linger));
+  args->received += Drain(fd, in, args->batch, 0);
+
+  free(payload);
+  free(scratch);
+  free(out);
+  free(in);
+  close(fd);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  const char *host = "127.0.0.1";
+  int port = 20001;
+  int threads_num = 1;
+  int size = 64;
+  int batch = 64;
+  double duration = 5;
+
+  while (true) {
+    static struct option options[] = {{"host", required_argument, 0, 0},
+                                      {"port", required_argument, 0, 0},
+                                      {"threads", required_argument, 0, 0},
+                                      {"size", required_argument, 0, 0},
+                                      {"batch", required_argument, 0, 0},
+                                      {"duration", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 0:
+      switch (option_index) {
+      case 0:
+        host = optarg;
+        break;
+      case 1:
+        port = atoi(optarg);
+        break;
+      case 2:
+        threads_num = atoi(optarg);
+        break;
+      case 3:
+        size = atoi(optarg);
+        break;
+      case 4:
+        batch = atoi(optarg);
+        break;
+      case 5:
+        duration = atof(optarg);
+        break;
+      }
+      break;
+
+    case '?':
+      printf("Arguments error\n");
+      break;
+    }
+  }
+
+  struct sockaddr_in server;
+  memset(&server, 0, sizeof(server));
+  server.sin_family = AF_INET;
+  server.sin_port = htons(port);
+  if (port <= 0 || port > 65535 || threads_num <= 0 || size <= 0 ||
+      size > MAX_SIZE || batch <= 0 || batch > MAX_BATCH || duration <= 0 ||
+      inet_pton(AF_INET, host, &server.sin_addr) != 1) {
+    fprintf(stderr,
+            "Using: %s [--host 127.0.0.1] [--port 20001] [--threads 1] "
+            "[--size 64] [--batch 1..%d] [--duration 5]\n",
+            argv[0], MAX_BATCH);
+    return 1;
+  }
+
+  struct BlastArgs *args = calloc(threads_num, sizeof(struct BlastArgs));
+  pthread_t *threads = calloc(threads_num, sizeof(pthread_t));
+  if (args == NULL || threads == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+
+  double started = NowSeconds();
+  for (int i = 0; i < threads_num; i++) {
+    args[i].server = server;
+    args[i].size = size;
+    args[i].batch = batch;
+    args[i].duration = duration;
+    if (pthread_create(&threads[i], NULL, BlastThread, &args[i])) {
+      fprintf(stderr, "Error: pthread_create failed!\n");
+      return 1;
+    }
+  }
+
+  unsigned long long sent = 0, received = 0;
+  int errors = 0;
+  for (int i = 0; i < threads_num; i++) {
+    pthread_join(threads[i], NULL);
+    sent += args[i].sent;
+    received += args[i].received;
+    errors += args[i].errors;
+  }
+  double elapsed = NowSeconds() - started;
+
+  printf("threads: %d, size: %d, batch: %d\n", threads_num, size, batch);
+  printf("sent: %llu packets, %.3f Mpps, %.1f MB/s\n", sent,
+         sent / elapsed / 1e6, (double)sent * size / elapsed / 1e6);
+  printf("echoed: %llu packets (%.1f%%), %.3f Mpps\n", received,
+         sent ? 100.0 * received / sent : 0.0, received / elapsed / 1e6);
+
+  free(args);
+  free(threads);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define MAX_DATAGRAM 65536
+#define QUEUE_SIZE 65536
+
+// Loopback proxy that drops and delays datagrams, for testing the reliable
+// transfer without a bad network. Clients talk to --listen, the proxy
+// forwards to --port on --host and sends replies back to the last client
+// heard from. Each direction loses --loss of its datagrams at random and
+// holds the rest for --delay ms. --reorder of the survivors are held
+// --reorder-delay ms longer, so datagrams sent after them overtake them.
+// Within each of the two delays release order is arrival order, so every
+// delay gets a plain FIFO.
+struct Delayed {
+  uint64_t release_us;
+  bool to_server;
+  size_t len;
+  char *data;
+};
+
+struct Queue {
+  struct Delayed items[QUEUE_SIZE];
+  size_t head;
+  size_t count;
+};
+
+struct Stats {
+  unsigned long long forwarded;
+  unsigned long long dropped;
+  unsigned long long overflowed;
+  unsigned long long reordered;
+};
+
+static uint64_t NowUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void Forward(int client_fd, int server_fd,
+                    const struct sockaddr_in *client, bool to_server,
+                    const char *data, size_t len) {
+  // Send errors are losses too, the endpoints have to cope
+  if (to_server)
+    send(server_fd, data, len, MSG_DONTWAIT);
+  else
+    sendto(client_fd, data, len, MSG_DONTWAIT, (struct sockaddr *)client,
+           sizeof(*client));
+}
+
+static void Release(struct Queue *queue, uint64_t now, int client_fd,
+                    int server_fd, const struct sockaddr_in *client) {
+  while (queue->count > 0 && queue->items[queue->head].release_us <= now) {
+    struct Delayed *d = &queue->items[queue->head];
+    Forward(client_fd, server_fd, client, d->to_server, d->data, d->len);
+    free(d->data);
+    queue->head = (queue->head + 1) % QUEUE_SIZE;
+    queue->count--;
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *host = "127.0.0.1";
+  int listen_port = 0;
+  int port = 0;
+  double loss = 0.0;
+  double delay_ms = 0.0;
+  double reorder = 0.0;
+  double reorder_delay_ms = 30.0;
+  unsigned int seed = (unsigned int)time(NULL);
+
+  while (true) {
+    static struct option options[] = {{"listen", required_argument, 0, 0},
+                                      {"host", required_argument, 0, 0},
+                                      {"port", required_argument, 0, 0},
+                                      {"loss", required_argument, 0, 0},
+                                      {"delay", required_argument, 0, 0},
+                                      {"seed", required_argument, 0, 0},
+                                      {"reorder", required_argument, 0, 0},
+                                      {"reorder-delay", required_argument, 0,
+                                       0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 0:
+      switch (option_index) {
+      case 0:
+        listen_port = atoi(optarg);
+        break;
+      case 1:
+        host = optarg;
+        break;
+      case 2:
+        port = atoi(optarg);
+        break;
+      case 3:
+        loss = atof(optarg);
+        break;
+      case 4:
+        delay_ms = atof(optarg);
+        break;
+      case 5:
+        seed = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 6:
+        reorder = atof(optarg);
+        break;
+      case 7:
+        reorder_delay_ms = atof(optarg);
+        break;
+      }
+      break;
+
+    case '?':
+      printf("Arguments error\n");
+      break;
+    }
+  }
+
+  struct sockaddr_in server;
+  memset(&server, 0, sizeof(server));
+  server.sin_family = AF_INET;
+  server.sin_port = htons(port);
+  if (listen_port <= 0 || listen_port > 65535 || port <= 0 || port > 65535 ||
+      loss < 0 || loss > 1 || delay_ms < 0 || reorder < 0 || reorder > 1 ||
+      reorder_delay_ms < 0 ||
+      inet_pton(AF_INET, host, &server.sin_addr) != 1) {
+    fprintf(stderr,
+            "Using: %s --listen 20002 --port 20001 [--host 127.0.0.1] "
+            "[--loss 0.0..1.0] [--delay ms] [--reorder 0.0..1.0] "
+            "[--reorder-delay ms] [--seed N]\n",
+            argv[0]);
+    return 1;
+  }
+
+  int client_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int server_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons(listen_port);
+  if (client_fd < 0 || server_fd < 0 ||
+      bind(client_fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+      connect(server_fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
+    perror("socket problem");
+    return 1;
+  }
+  int size = 4 * 1024 * 1024;
+  setsockopt(client_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  setsockopt(server_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  // [0] held for delay, [1] for delay + reorder_delay
+  struct Queue *queues = calloc(2, sizeof(struct Queue));
+  char *buf = malloc(MAX_DATAGRAM);
+  if (queues == NULL || buf == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  printf("PROXY :%d -> %s:%d, loss %.1f%%, delay %.1f ms, reorder %.1f%% "
+         "by %.1f ms\n",
+         listen_port, host, port, loss * 100, delay_ms, reorder * 100,
+         reorder_delay_ms);
+  fflush(stdout);
+
+  struct sockaddr_in client;
+  bool have_client = false;
+  struct Stats stats[2] = {{0}}; // [0] towards the server, [1] back
+  uint64_t delays_us[2] = {(uint64_t)(delay_ms * 1000),
+                           (uint64_t)((delay_ms + reorder_delay_ms) * 1000)};
+  uint64_t report = NowUs() + 1000000;
+
+  while (1) {
+    uint64_t now = NowUs();
+    int timeout = 100;
+    for (int q = 0; q < 2; q++) {
+      Release(&queues[q], now, client_fd, server_fd, &client);
+      if (queues[q].count > 0) {
+        uint64_t wait = queues[q].items[queues[q].head].release_us - now;
+        if ((int)((wait + 999) / 1000) < timeout)
+          timeout = (int)((wait + 999) / 1000);
+      }
+    }
+    struct pollfd pfds[2] = {{client_fd, POLLIN, 0}, {server_fd, POLLIN, 0}};
+    if (poll(pfds, 2, timeout) < 0 && errno != EINTR) {
+      perror("poll");
+      return 1;
+    }
+
+    for (int side = 0; side < 2; side++) {
+      if (!(pfds[side].revents & POLLIN))
+        continue;
+      bool to_server = side == 0;
+      while (1) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(pfds[side].fd, buf, MAX_DATAGRAM, MSG_DONTWAIT,
+                             (struct sockaddr *)&from, &from_len);
+        if (n < 0)
+          break;
+        if (to_server) {
+          client = from;
+          have_client = true;
+        } else if (!have_client) {
+          continue;
+        }
+
+        struct Stats *st = &stats[to_server ? 0 : 1];
+        if (rand_r(&seed) < loss * ((double)RAND_MAX + 1)) {
+          st->dropped++;
+          continue;
+        }
+        st->forwarded++;
+        bool late = reorder > 0 &&
+                    rand_r(&seed) < reorder * ((double)RAND_MAX + 1);
+        if (late)
+          st->reordered++;
+        struct Queue *queue = &queues[late ? 1 : 0];
+        uint64_t delay_us = delays_us[late ? 1 : 0];
+        if (delay_us == 0) {
+          Forward(client_fd, server_fd, &client, to_server, buf, (size_t)n);
+          continue;
+        }
+        char *copy = malloc((size_t)n);
+        if (queue->count == QUEUE_SIZE || copy == NULL) {
+          free(copy);
+          st->overflowed++;
+          continue;
+        }
+        memcpy(copy, buf, (size_t)n);
+        struct Delayed *d =
+            &queue->items[(queue->head + queue->count++) % QUEUE_SIZE];
+        *d = (struct Delayed){NowUs() + delay_us, to_server, (size_t)n, copy};
+      }
+    }
+
+    if (NowUs() >= report) {
+      if (stats[0].forwarded + stats[0].dropped + stats[1].forwarded > 0) {
+        printf("to server: %llu forwarded, %llu dropped; "
+               "to client: %llu forwarded, %llu dropped; %llu overflowed, "
+               "%llu reordered\n",
+               stats[0].forwarded, stats[0].dropped, stats[1].forwarded,
+               stats[1].dropped, stats[0].overflowed + stats[1].overflowed,
+               stats[0].reordered + stats[1].reordered);
+        fflush(stdout);
+      }
+      report += 1000000;
+    }
+  }
+}
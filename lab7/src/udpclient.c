@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,47 +10,354 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "rudp.h"
+
 #define SERV_PORT 20001
 #define BUFSIZE 1024
 #define SADDR struct sockaddr
 #define SLEN sizeof(struct sockaddr_in)
+#define REPLY_TIMEOUT_MS 1000
+#define REPLY_ATTEMPTS 3
+
+#define WINDOW 256
+#define MIN_RTO_US 2000
+#define MAX_RTO_US 2000000
+#define INITIAL_RTO_US 200000
+#define DUP_THRESHOLD 3
+
+// Segment of the send window; slot seq % window holds segment seq
+struct Segment {
+  uint16_t len;
+  bool fin;
+  bool acked;
+  uint64_t sent_us;
+  char data[RUDP_MSS];
+};
+
+struct Sender {
+  int sockfd;
+  int input;
+  uint32_t session;
+  uint32_t window;
+  struct Segment *slots;
+  uint32_t base;    // lowest unacknowledged segment
+  uint32_t next;    // next segment to send for the first time
+  uint32_t fin_seq; // UINT32_MAX until the input is exhausted
+  uint32_t highest_sacked;
+  // RFC 6298 estimator, microseconds
+  double srtt;
+  double rttvar;
+  uint64_t rto;
+  uint64_t next_check;
+  uint64_t last_progress;
+  uint64_t started;
+  unsigned long long bytes;
+  unsigned long long retransmits;
+  unsigned long long timeouts;
+};
+
+static uint64_t NowUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void SendSegment(struct Sender *s, uint32_t seq) {
+  struct Segment *seg = &s->slots[seq % s->window];
+  char packet[RUDP_HEADER_SIZE + RUDP_MSS];
+  uint64_t now = NowUs();
+  struct RudpHeader h = {RUDP_DATA, seg->fin ? RUDP_FIN : 0, seg->len,
+                         s->session, seq, (uint32_t)now};
+  RudpEncode(packet, &h);
+  memcpy(packet + RUDP_HEADER_SIZE, seg->data, seg->len);
+  // A full socket buffer is just another loss; the timer resends it
+  if (send(s->sockfd, packet, RUDP_HEADER_SIZE + seg->len, 0) < 0 &&
+      errno != EAGAIN && errno != ENOBUFS && errno != ECONNREFUSED) {
+    perror("send");
+    exit(1);
+  }
+  seg->sent_us = now;
+  if (now + s->rto < s->next_check)
+    s->next_check = now + s->rto;
+}
+
+static void Retransmit(struct Sender *s, uint32_t seq) {
+  s->retransmits++;
+  SendSegment(s, seq);
+}
+
+// Reads and sends new segments while the window has room
+static void FillWindow(struct Sender *s) {
+  while (s->next < s->base + s->window && s->fin_seq == UINT32_MAX) {
+    struct Segment *seg = &s->slots[s->next % s->window];
+    ssize_t n;
+    do
+      n = read(s->input, seg->data, RUDP_MSS);
+    while (n < 0 && errno == EINTR);
+    if (n < 0) {
+      perror("read");
+      exit(1);
+    }
+    seg->len = (uint16_t)n;
+    seg->fin = n == 0;
+    seg->acked = false;
+    if (seg->fin)
+      s->fin_seq = s->next;
+    s->bytes += n;
+    SendSegment(s, s->next++);
+  }
+}
+
+static void SampleRtt(struct Sender *s, uint32_t echoed) {
+  double rtt = (uint32_t)((uint32_t)NowUs() - echoed);
+  if (s->srtt == 0) {
+    s->srtt = rtt;
+    s->rttvar = rtt / 2;
+  } else {
+    double err = rtt > s->srtt ? rtt - s->srtt : s->srtt - rtt;
+    s->rttvar = 0.75 * s->rttvar + 0.25 * err;
+    s->srtt = 0.875 * s->srtt + 0.125 * rtt;
+  }
+  uint64_t rto = (uint64_t)(s->srtt + 4 * s->rttvar);
+  s->rto = rto < MIN_RTO_US ? MIN_RTO_US : rto > MAX_RTO_US ? MAX_RTO_US : rto;
+}
+
+static void HandleAck(struct Sender *s, const char *packet, size_t size) {
+  struct RudpHeader h;
+  if (size < RUDP_ACK_SIZE || !RudpDecode(packet, size, &h) ||
+      h.type != RUDP_ACK || h.session != s->session)
+    return;
+  const char *sack = packet + RUDP_HEADER_SIZE;
+
+  // Every ack echoes the timestamp of a segment that really arrived, so
+  // the sample is valid even when that segment was a retransmission
+  SampleRtt(s, h.ts);
+
+  uint32_t cum = h.seq;
+  if (cum > s->next)
+    return; // acks something never sent: garbage
+  uint32_t old_base = s->base;
+  if (cum > s->base)
+    s->base = cum;
+  // A delayed ack may report a cum below base; its bits for segments
+  // already behind base name slots that now hold newer segments
+  for (uint32_t i = s->base > cum + 1 ? s->base - cum - 1 : 0;
+       i + 1 < RUDP_MAX_WINDOW; i++) {
+    uint32_t seq = cum + 1 + i;
+    if (seq >= s->next)
+      break;
+    if (RudpSackTest(sack, i)) {
+      s->slots[seq % s->window].acked = true;
+      if (seq > s->highest_sacked)
+        s->highest_sacked = seq;
+    }
+  }
+  while (s->base < s->next && s->slots[s->base % s->window].acked)
+    s->base++;
+  uint64_t now = NowUs();
+  if (s->base != old_base)
+    s->last_progress = now;
+
+  // Fast retransmit: a hole with DUP_THRESHOLD later segments already
+  // acknowledged is lost, unless it was resent less than an RTT ago
+  for (uint32_t seq = s->base; seq + DUP_THRESHOLD <= s->highest_sacked &&
+                               seq < s->next;
+       seq++) {
+    struct Segment *seg = &s->slots[seq % s->window];
+    if (!seg->acked && now - seg->sent_us > (uint64_t)s->srtt)
+      Retransmit(s, seq);
+  }
+}
+
+static void CheckTimeouts(struct Sender *s) {
+  uint64_t now = NowUs();
+  if (now < s->next_check)
+    return;
+  s->next_check = UINT64_MAX;
+  bool expired = false;
+  for (uint32_t seq = s->base; seq < s->next; seq++) {
+    struct Segment *seg = &s->slots[seq % s->window];
+    if (seg->acked)
+      continue;
+    if (now - seg->sent_us >= s->rto) {
+      expired = true;
+      Retransmit(s, seq);
+    } else if (seg->sent_us + s->rto < s->next_check) {
+      s->next_check = seg->sent_us + s->rto;
+    }
+  }
+  // Back off once per expiry round, not once per segment
+  if (expired) {
+    s->timeouts++;
+    s->rto = s->rto * 2 > MAX_RTO_US ? MAX_RTO_US : s->rto * 2;
+  }
+}
+
+static int SendFile(struct sockaddr_in *servaddr, const char *path,
+                    uint32_t window) {
+  struct Sender s = {0};
+  s.input = strcmp(path, "-") == 0 ? 0 : open(path, O_RDONLY);
+  if (s.input < 0) {
+    perror(path);
+    return 1;
+  }
+  if ((s.sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+      connect(s.sockfd, (SADDR *)servaddr, SLEN) < 0) {
+    perror("socket problem");
+    return 1;
+  }
+  int size = 4 * 1024 * 1024;
+  setsockopt(s.sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  setsockopt(s.sockfd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+  s.window = window;
+  s.slots = calloc(window, sizeof(struct Segment));
+  if (s.slots == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  s.session = ((uint32_t)getpid() ^ (uint32_t)NowUs()) | 1; // 0 is "none"
+  s.fin_seq = UINT32_MAX;
+  s.rto = INITIAL_RTO_US;
+  s.next_check = UINT64_MAX;
+  s.started = s.last_progress = NowUs();
+
+  char packet[RUDP_ACK_SIZE];
+  while (s.fin_seq == UINT32_MAX || s.base <= s.fin_seq) {
+    FillWindow(&s);
+
+    uint64_t now = NowUs();
+    if (now - s.last_progress > RUDP_IDLE_LIMIT_US) {
+      fprintf(stderr, "No progress for %d s, giving up at segment %u\n",
+              RUDP_IDLE_LIMIT_US / 1000000, s.base);
+      return 1;
+    }
+    uint64_t wait = s.next_check > now ? s.next_check - now : 0;
+    if (wait > 100000)
+      wait = 100000;
+    struct timespec timeout = {0, (long)wait * 1000};
+    struct pollfd pfd = {s.sockfd, POLLIN, 0};
+    if (ppoll(&pfd, 1, &timeout, NULL) < 0 && errno != EINTR) {
+      perror("ppoll");
+      return 1;
+    }
+
+    ssize_t n;
+    while ((n = recv(s.sockfd, packet, sizeof(packet), MSG_DONTWAIT)) >= 0)
+      HandleAck(&s, packet, (size_t)n);
+    CheckTimeouts(&s);
+  }
+
+  double seconds = (NowUs() - s.started) / 1e6;
+  printf("sent %llu bytes in %u segments, %.3f s, %.1f MB/s\n", s.bytes,
+         s.fin_seq + 1, seconds, s.bytes / seconds / 1e6);
+  printf("retransmits: %llu, timeouts: %llu, srtt: %.0f us, rto: %llu us\n",
+         s.retransmits, s.timeouts, s.srtt, (unsigned long long)s.rto);
+
+  free(s.slots);
+  if (s.input != 0)
+    close(s.input);
+  close(s.sockfd);
+  return 0;
+}
 
 int main(int argc, char **argv) {
   int sockfd, n;
   char sendline[BUFSIZE], recvline[BUFSIZE + 1];
   struct sockaddr_in servaddr;
-  struct sockaddr_in cliaddr;
+  int port = SERV_PORT;
+  const char *send_path = NULL;
+  int window = WINDOW;
+
+  while (true) {
+    static struct option options[] = {{"port", required_argument, 0, 0},
+                                      {"send", required_argument, 0, 0},
+                                      {"window", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 0:
+      switch (option_index) {
+      case 0:
+        port = atoi(optarg);
+        break;
+      case 1:
+        send_path = optarg;
+        break;
+      case 2:
+        window = atoi(optarg);
+        break;
+      }
+      break;
 
-  if (argc != 2) {
-    printf("usage: client <IPaddress of server>\n");
+    case '?':
+      printf("Arguments error\n");
+      break;
+    }
+  }
+
+  if (optind + 1 != argc || port <= 0 || port > 65535 || window <= 0 ||
+      window > RUDP_MAX_WINDOW) {
+    printf("usage: client <IPaddress of server> [--port %d] "
+           "[--send FILE|- [--window 1..%d]]\n",
+           SERV_PORT, RUDP_MAX_WINDOW);
     exit(1);
   }
 
   memset(&servaddr, 0, sizeof(servaddr));
   servaddr.sin_family = AF_INET;
-  servaddr.sin_port = htons(SERV_PORT);
+  servaddr.sin_port = htons(port);
 
-  if (inet_pton(AF_INET, argv[1], &servaddr.sin_addr) < 0) {
+  if (inet_pton(AF_INET, argv[optind], &servaddr.sin_addr) != 1) {
     perror("inet_pton problem");
     exit(1);
   }
+  if (send_path != NULL)
+    return SendFile(&servaddr, send_path, (uint32_t)window);
+
   if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
     perror("socket problem");
     exit(1);
   }
+  // A lost request or reply must not hang the client forever
+  struct timeval timeout = {REPLY_TIMEOUT_MS / 1000,
+                            REPLY_TIMEOUT_MS % 1000 * 1000};
+  setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
   write(1, "Enter string\n", 13);
 
   while ((n = read(0, sendline, BUFSIZE)) > 0) {
-    if (sendto(sockfd, sendline, n, 0, (SADDR *)&servaddr, SLEN) == -1) {
-      perror("sendto problem");
-      exit(1);
+    int attempt, got = -1;
+    for (attempt = 0; attempt < REPLY_ATTEMPTS && got < 0; attempt++) {
+      if (sendto(sockfd, sendline, n, 0, (SADDR *)&servaddr, SLEN) == -1) {
+        perror("sendto problem");
+        exit(1);
+      }
+      got = recvfrom(sockfd, recvline, BUFSIZE, 0, NULL, NULL);
+      if (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("recvfrom problem");
+        exit(1);
+      }
     }
-
-    if (recvfrom(sockfd, recvline, BUFSIZE, 0, NULL, NULL) == -1) {
-      perror("recvfrom problem");
-      exit(1);
+    if (got < 0) {
+      printf("NO REPLY FROM SERVER after %d attempts\n", REPLY_ATTEMPTS);
+      continue;
     }
+    recvline[got] = 0;
 
     printf("REPLY FROM SERVER= %s\n", recvline);
   }
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <stdio.h>
@@ -8,37 +9,512 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "rudp.h"
+
 #define SERV_PORT 20001
 #define BUFSIZE 1024
 #define SADDR struct sockaddr
 #define SLEN sizeof(struct sockaddr_in)
+#define BATCH 64
+#define MAX_BATCH 1024
 
-int main() {
-  int sockfd, n;
-  char mesg[BUFSIZE], ipadr[16];
+// High-rate mode (--threads N): every worker owns an SO_REUSEPORT socket
+// bound to the same port, so the kernel spreads clients across them, and
+// echoes datagrams in recvmmsg/sendmmsg batches. Instead of a printf per
+// request the workers bump counters that the main thread prints once per
+// --interval; --sample N still logs one request in N.
+struct Counters {
+  atomic_ullong packets;
+  atomic_ullong bytes;
+  atomic_ullong batches;
+} __attribute__((aligned(64)));
+
+struct ServerOptions {
+  int port;
+  int bufsize;
+  int threads;
+  int batch;
+  unsigned long sample;
+  double interval;
+  const char *receive;
+};
+
+struct Worker {
+  pthread_t thread;
+  int sockfd;
+  struct Counters counters;
+  const struct ServerOptions *opts;
+};
+
+static int OpenSocket(int port, bool reuseport) {
+  int sockfd;
   struct sockaddr_in servaddr;
-  struct sockaddr_in cliaddr;
 
   if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
     perror("socket problem");
     exit(1);
   }
+  if (reuseport) {
+    int one = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+      perror("SO_REUSEPORT");
+      exit(1);
+    }
+    // Bursts of a whole batch per client must fit in the socket buffer
+    int size = 4 * 1024 * 1024;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  }
 
   memset(&servaddr, 0, SLEN);
   servaddr.sin_family = AF_INET;
   servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-  servaddr.sin_port = htons(SERV_PORT);
+  servaddr.sin_port = htons(port);
 
   if (bind(sockfd, (SADDR *)&servaddr, SLEN) < 0) {
     perror("bind problem");
     exit(1);
   }
+  return sockfd;
+}
+
+static void *WorkerLoop(void *arg) {
+  struct Worker *worker = (struct Worker *)arg;
+  const struct ServerOptions *opts = worker->opts;
+  int batch = opts->batch;
+
+  char *buffers = malloc((size_t)batch * opts->bufsize);
+  struct mmsghdr *msgs = calloc(batch, sizeof(struct mmsghdr));
+  struct iovec *iovs = calloc(batch, sizeof(struct iovec));
+  struct sockaddr_in *addrs = calloc(batch, sizeof(struct sockaddr_in));
+  if (!buffers || !msgs || !iovs || !addrs) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  unsigned long long seen = 0;
+  while (1) {
+    for (int i = 0; i < batch; i++) {
+      iovs[i].iov_base = buffers + (size_t)i * opts->bufsize;
+      iovs[i].iov_len = opts->bufsize;
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = SLEN;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // Blocks for the first datagram, then takes whatever else is queued
+    int n = recvmmsg(worker->sockfd, msgs, batch, MSG_WAITFORONE, NULL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("recvmmsg");
+      exit(1);
+    }
+
+    unsigned long long bytes = 0;
+    for (int i = 0; i < n; i++) {
+      // Echo exactly what came in, to the address it came from
+      iovs[i].iov_len = msgs[i].msg_len;
+      bytes += msgs[i].msg_len;
+      if (opts->sample && ++seen % opts->sample == 0) {
+        char ipadr[16];
+        printf("REQUEST %.*s      FROM %s : %d\n", (int)msgs[i].msg_len,
+               (char *)iovs[i].iov_base,
+               inet_ntop(AF_INET, &addrs[i].sin_addr, ipadr, 16),
+               ntohs(addrs[i].sin_port));
+      }
+    }
+
+    for (int sent = 0; sent < n;) {
+      int m = sendmmsg(worker->sockfd, msgs + sent, n - sent, 0);
+      if (m < 0) {
+        if (errno == EINTR)
+          continue;
+        perror("sendmmsg");
+        break; // drop the rest of the batch, UDP may lose it anyway
+      }
+      sent += m;
+    }
+
+    atomic_fetch_add_explicit(&worker->counters.packets, n,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&worker->counters.bytes, bytes,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&worker->counters.batches, 1,
+                              memory_order_relaxed);
+  }
+  return NULL;
+}
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void RunWorkers(const struct ServerOptions *opts) {
+  struct Worker *workers = calloc(opts->threads, sizeof(struct Worker));
+  if (workers == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  for (int i = 0; i < opts->threads; i++) {
+    workers[i].sockfd = OpenSocket(opts->port, true);
+    workers[i].opts = opts;
+    if (pthread_create(&workers[i].thread, NULL, WorkerLoop, &workers[i])) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+  printf("SERVER starts: %d workers, batch %d\n", opts->threads, opts->batch);
+  fflush(stdout);
+
+  unsigned long long last_packets = 0;
+  unsigned long long last_bytes = 0;
+  double last = NowSeconds();
+  while (1) {
+    struct timespec pause = {(time_t)opts->interval,
+                             (long)((opts->interval - (time_t)opts->interval) *
+                                    1e9)};
+    nanosleep(&pause, NULL);
+
+    unsigned long long packets = 0, bytes = 0, batches = 0;
+    for (int i = 0; i < opts->threads; i++) {
+      packets += atomic_load_explicit(&workers[i].counters.packets,
+                                      memory_order_relaxed);
+      bytes += atomic_load_explicit(&workers[i].counters.bytes,
+                                    memory_order_relaxed);
+      batches += atomic_load_explicit(&workers[i].counters.batches,
+                                      memory_order_relaxed);
+    }
+    double now = NowSeconds();
+    if (packets != last_packets) {
+      printf("%.3f Mpps, %.1f MB/s, %llu packets total, %.1f per batch\n",
+             (packets - last_packets) / (now - last) / 1e6,
+             (bytes - last_bytes) / (now - last) / 1e6, packets,
+             batches ? (double)packets / batches : 0.0);
+      fflush(stdout);
+    }
+    last_packets = packets;
+    last_bytes = bytes;
+    last = now;
+  }
+}
+
+// Reliable transfer receiver (--receive FILE): accepts one udpclient --send
+// session at a time, buffers out-of-order segments of the window, writes
+// the in-order prefix to FILE and acks every batch of datagrams with the
+// cumulative sequence plus a selective ack bitmap.
+struct Reassembly {
+  bool present;
+  bool fin;
+  uint16_t len;
+  char data[RUDP_MSS];
+};
+
+struct Receiver {
+  int sockfd;
+  int output;
+  struct Reassembly *slots;
+  bool active;
+  uint32_t session;
+  uint32_t cum; // next segment expected in order
+  struct sockaddr_in peer;
+  uint32_t last_ts;
+  double started;
+  double last_heard; // last datagram of the active session
+  unsigned long long bytes;
+  unsigned long long segments;
+  unsigned long long duplicates;
+};
+
+static void SendAck(struct Receiver *r) {
+  char packet[RUDP_ACK_SIZE];
+  struct RudpHeader h = {RUDP_ACK, 0, 0, r->session, r->cum, r->last_ts};
+  RudpEncode(packet, &h);
+  char *sack = packet + RUDP_HEADER_SIZE;
+  memset(sack, 0, RUDP_SACK_BYTES);
+  for (uint32_t i = 0; i + 1 < RUDP_MAX_WINDOW; i++) {
+    if (r->slots[(r->cum + 1 + i) % RUDP_MAX_WINDOW].present)
+      RudpSackSet(sack, i);
+  }
+  if (sendto(r->sockfd, packet, sizeof(packet), 0, (SADDR *)&r->peer, SLEN) <
+          0 &&
+      errno != EAGAIN && errno != ENOBUFS)
+    perror("sendto");
+}
+
+static void WriteAll(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      perror("write");
+      exit(1);
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+}
+
+// Writes the in-order prefix; returns true once the FIN segment is reached
+static bool Deliver(struct Receiver *r) {
+  while (true) {
+    struct iovec iov[64];
+    int iovcnt = 0;
+    size_t total = 0;
+    bool fin = false;
+    for (uint32_t seq = r->cum; iovcnt < 64; seq++) {
+      struct Reassembly *slot = &r->slots[seq % RUDP_MAX_WINDOW];
+      if (!slot->present)
+        break;
+      if (slot->fin) {
+        fin = true;
+        break;
+      }
+      iov[iovcnt].iov_base = slot->data;
+      iov[iovcnt].iov_len = slot->len;
+      total += slot->len;
+      iovcnt++;
+    }
+    if (iovcnt == 0 && !fin)
+      return false;
+
+    ssize_t n = iovcnt ? writev(r->output, iov, iovcnt) : 0;
+    if (n < 0 && errno != EINTR) {
+      perror("writev");
+      exit(1);
+    }
+    // Finish a short write segment by segment
+    size_t written = n < 0 ? 0 : (size_t)n;
+    for (int i = 0; i < iovcnt; i++) {
+      if (written >= iov[i].iov_len) {
+        written -= iov[i].iov_len;
+        continue;
+      }
+      WriteAll(r->output, (char *)iov[i].iov_base + written,
+               iov[i].iov_len - written);
+      written = 0;
+    }
+    r->bytes += total;
+
+    for (int i = 0; i < iovcnt; i++)
+      r->slots[r->cum++ % RUDP_MAX_WINDOW].present = false;
+    if (fin) {
+      r->slots[r->cum++ % RUDP_MAX_WINDOW].present = false;
+      return true;
+    }
+  }
+}
+
+static void HandleData(struct Receiver *r, const struct sockaddr_in *from,
+                       const struct RudpHeader *h, const char *payload) {
+  double now = NowSeconds();
+  if (h->session != r->session) {
+    // Busy with another sender, it will retry; unless the current one has
+    // been silent so long that it must have died mid-transfer
+    if (r->active && now - r->last_heard < RUDP_IDLE_LIMIT_US / 1e6)
+      return;
+    if (r->active) {
+      printf("session %08x: abandoned after %llu bytes, no data for %d s\n",
+             r->session, r->bytes, RUDP_IDLE_LIMIT_US / 1000000);
+      fflush(stdout);
+    }
+    r->active = true;
+    r->session = h->session;
+    r->cum = 0;
+    r->started = now;
+    r->bytes = r->segments = r->duplicates = 0;
+    for (int i = 0; i < RUDP_MAX_WINDOW; i++)
+      r->slots[i].present = false;
+  }
+  r->peer = *from;
+  r->last_ts = h->ts;
+  r->last_heard = now;
+  // A finished session only gets its final ack repeated
+  if (!r->active)
+    return;
+
+  if (h->seq < r->cum || h->seq - r->cum >= RUDP_MAX_WINDOW ||
+      r->slots[h->seq % RUDP_MAX_WINDOW].present) {
+    r->duplicates++;
+    return;
+  }
+  struct Reassembly *slot = &r->slots[h->seq % RUDP_MAX_WINDOW];
+  slot->present = true;
+  slot->fin = h->flags & RUDP_FIN;
+  slot->len = h->len;
+  memcpy(slot->data, payload, h->len);
+  r->segments++;
+
+  if (Deliver(r)) {
+    double seconds = NowSeconds() - r->started;
+    printf("session %08x: %llu bytes in %llu segments, %.3f s, %.1f MB/s, "
+           "%llu duplicates\n",
+           r->session, r->bytes, r->segments, seconds,
+           r->bytes / seconds / 1e6, r->duplicates);
+    fflush(stdout);
+    r->active = false;
+  }
+}
+
+static void RunReceiver(const struct ServerOptions *opts) {
+  struct Receiver r = {0};
+  r.sockfd = OpenSocket(opts->port, false);
+  int size = 4 * 1024 * 1024;
+  setsockopt(r.sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  r.output = strcmp(opts->receive, "-") == 0
+                 ? 1
+                 : open(opts->receive, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  r.slots = calloc(RUDP_MAX_WINDOW, sizeof(struct Reassembly));
+  if (r.output < 0 || r.slots == NULL) {
+    perror(opts->receive);
+    exit(1);
+  }
+  if (r.output == 1)
+    fprintf(stderr, "SERVER receives on port %d\n", opts->port);
+  else
+    printf("SERVER receives on port %d into %s\n", opts->port, opts->receive);
+  fflush(stdout);
+
+  int batch = opts->batch;
+  char *buffers = malloc((size_t)batch * (RUDP_HEADER_SIZE + RUDP_MSS));
+  struct mmsghdr *msgs = calloc(batch, sizeof(struct mmsghdr));
+  struct iovec *iovs = calloc(batch, sizeof(struct iovec));
+  struct sockaddr_in *addrs = calloc(batch, sizeof(struct sockaddr_in));
+  if (!buffers || !msgs || !iovs || !addrs) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  while (1) {
+    for (int i = 0; i < batch; i++) {
+      iovs[i].iov_base = buffers + (size_t)i * (RUDP_HEADER_SIZE + RUDP_MSS);
+      iovs[i].iov_len = RUDP_HEADER_SIZE + RUDP_MSS;
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = SLEN;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n = recvmmsg(r.sockfd, msgs, batch, MSG_WAITFORONE, NULL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("recvmmsg");
+      exit(1);
+    }
+
+    // One ack per batch keeps the ack rate bounded under load while a
+    // slow sender still gets one per datagram
+    bool ack = false;
+    for (int i = 0; i < n; i++) {
+      struct RudpHeader h;
+      const char *packet = iovs[i].iov_base;
+      if (!RudpDecode(packet, msgs[i].msg_len, &h) || h.type != RUDP_DATA ||
+          h.len > RUDP_MSS || RUDP_HEADER_SIZE + h.len != msgs[i].msg_len)
+        continue;
+      HandleData(&r, &addrs[i], &h, packet + RUDP_HEADER_SIZE);
+      ack = true;
+    }
+    if (ack)
+      SendAck(&r);
+  }
+}
+
+int main(int argc, char **argv) {
+  struct ServerOptions opts = {SERV_PORT, BUFSIZE, 0, BATCH, 0, 1.0, NULL};
+
+  while (true) {
+    static struct option options[] = {{"port", required_argument, 0, 0},
+                                      {"bufsize", required_argument, 0, 0},
+                                      {"threads", required_argument, 0, 0},
+                                      {"batch", required_argument, 0, 0},
+                                      {"sample", required_argument, 0, 0},
+                                      {"interval", required_argument, 0, 0},
+                                      {"receive", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 0:
+      switch (option_index) {
+      case 0:
+        opts.port = atoi(optarg);
+        break;
+      case 1:
+        opts.bufsize = atoi(optarg);
+        break;
+      case 2:
+        opts.threads = atoi(optarg);
+        break;
+      case 3:
+        opts.batch = atoi(optarg);
+        break;
+      case 4:
+        opts.sample = strtoul(optarg, NULL, 10);
+        break;
+      case 5:
+        opts.interval = atof(optarg);
+        break;
+      case 6:
+        opts.receive = optarg;
+        break;
+      }
+      break;
+
+    case '?':
+      printf("Arguments error\n");
+      break;
+    }
+  }
+
+  if (opts.port <= 0 || opts.port > 65535 || opts.bufsize <= 0 ||
+      opts.threads < 0 || opts.batch <= 0 || opts.batch > MAX_BATCH ||
+      opts.interval <= 0) {
+    fprintf(stderr,
+            "Using: %s [--port %d] [--bufsize %d]\n"
+            "          [--threads N [--batch %d] [--sample N] [--interval 1]]\n"
+            "          [--receive FILE|- [--batch %d]]\n",
+            argv[0], SERV_PORT, BUFSIZE, BATCH, BATCH);
+    exit(1);
+  }
+  if (opts.receive != NULL) {
+    RunReceiver(&opts);
+    return 0;
+  }
+  if (opts.threads > 0) {
+    RunWorkers(&opts);
+    return 0;
+  }
+
+  // The original one-datagram-at-a-time loop
+  int sockfd, n;
+  char mesg[opts.bufsize + 1], ipadr[16];
+  struct sockaddr_in cliaddr;
+
+  sockfd = OpenSocket(opts.port, false);
   printf("SERVER starts...\n");
 
   while (1) {
     unsigned int len = SLEN;
 
-    if ((n = recvfrom(sockfd, mesg, BUFSIZE, 0, (SADDR *)&cliaddr, &len)) < 0) {
+    if ((n = recvfrom(sockfd, mesg, opts.bufsize, 0, (SADDR *)&cliaddr, &len)) < 0) {
       perror("recvfrom");
       exit(1);
     }